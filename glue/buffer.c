@@ -30,20 +30,211 @@
 
 #include <picoos.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "lwip/netbuf.h"
 #include "lwip/memp.h"
+#include "lwip/sys.h"
+#include "lwip/stats.h"
 
 #include "network/wwd_buffer_interface.h"
 #include "platform/wwd_bus_interface.h"
 #include "RTOS/wwd_rtos_interface.h"
 #include "wiced_utilities.h"
+#include "wd_glue.h"
+
+/*
+ * Tasks waiting for a PBUF_POOL buffer sleep on this semaphore.
+ * It is signalled from LWIP_HOOK_MEMP_AVAILABLE, which lwIP
+ * calls when an exhausted pool gets a buffer back, and when
+ * WWD releases a buffer. Without the hook buffers freed by lwIP
+ * are noticed by polling once per tick.
+ */
+static POSSEMA_t poolSema;
+static volatile int poolWaiters;
+
+/*
+ * Number of PBUF_POOL buffers that are kept available
+ * for the other direction. Allocation in TX direction fails
+ * if it would leave less than WDCFG_BUFFER_RX_RESERVE buffers
+ * in pool (and vice versa).
+ */
+#ifndef WDCFG_BUFFER_RX_RESERVE
+#define WDCFG_BUFFER_RX_RESERVE 0
+#endif
+
+#ifndef WDCFG_BUFFER_TX_RESERVE
+#define WDCFG_BUFFER_TX_RESERVE 0
+#endif
+
+#if (WDCFG_BUFFER_RX_RESERVE > 0 || WDCFG_BUFFER_TX_RESERVE > 0) && !MEMP_STATS
+#error "WDCFG_BUFFER_RX/TX_RESERVE needs MEMP_STATS for pool usage."
+#endif
+
+/*
+ * When allocation is refused because of reservation, pool is
+ * not empty and lwIP hook doesn't fire when buffers are freed.
+ * Waiter is woken up by host_buffer_release(), but buffers freed
+ * by lwIP itself are noticed only after this many ms.
+ */
+#ifndef WDCFG_BUFFER_LIMIT_WAIT
+#define WDCFG_BUFFER_LIMIT_WAIT 10
+#endif
+
+static WdBufferStats bufStats;
+
+#ifdef LWIP_HOOK_MEMP_AVAILABLE
+#define POOL_WAIT_TICKS(t) (t)
+#else
+#define POOL_WAIT_TICKS(t) ((t) == INFINITE ? 1 : MIN((t), 1))
+#endif
 
 wwd_result_t wwd_buffer_init(void* arg)
 {
+  if (poolSema == NULL) {
+
+    poolSema = nosSemaCreate(0, 0, "wwdpbuf");
+    if (poolSema == NULL)
+      return WWD_BUFFER_ALLOC_FAIL;
+  }
+
   return WWD_SUCCESS;
 }
 
+/*
+ * Called by lwIP (via LWIP_HOOK_MEMP_AVAILABLE in lwipopts.h)
+ * when a memory pool that was empty gets an element back.
+ */
+void wdMempAvailable(memp_t type)
+{
+  if (type == MEMP_PBUF_POOL && poolWaiters > 0)
+    nosSemaSignal(poolSema);
+}
+
+/*
+ * Try to allocate a pool pbuf, honoring the amount
+ * reserved for other direction.
+ */
+static struct pbuf* tryAlloc(wwd_buffer_dir_t direction,
+                             unsigned short size,
+                             bool* limited)
+{
+#if MEMP_STATS
+  int reserve = (direction == WWD_NETWORK_TX) ? WDCFG_BUFFER_RX_RESERVE : WDCFG_BUFFER_TX_RESERVE;
+
+  if (reserve > 0) {
+
+    const struct stats_mem* pool = lwip_stats.memp[MEMP_PBUF_POOL];
+
+    if ((int)(pool->avail - pool->used) <= reserve) {
+
+      *limited = true;
+      return NULL;
+    }
+  }
+#endif
+
+  *limited = false;
+  return pbuf_alloc(PBUF_RAW, size, PBUF_POOL);
+}
+
+/*
+ * Update counters once per allocation request.
+ */
+static void count(wwd_buffer_dir_t direction, unsigned short size, struct pbuf* p, bool limited)
+{
+  WdBufferCounters* cnt;
+
+  cnt = (direction == WWD_NETWORK_TX) ? &bufStats.tx : &bufStats.rx;
+  if (p != NULL) {
+
+    ++cnt->allocs;
+    WD_TRACE(WD_TRACE_BUF_GET, (direction << 16) | size);
+  }
+  else if (limited)
+    ++cnt->limitHits;
+  else
+    ++cnt->failures;
+}
+
+/*
+ * Allocate a pool pbuf, waiting at most timeout ticks
+ * (INFINITE = forever, 0 = don't wait) for one to be freed.
+ */
+static struct pbuf* poolAlloc(wwd_buffer_dir_t direction,
+                              unsigned short size,
+                              UINT_t timeout)
+{
+  struct pbuf* p;
+  JIF_t        deadline;
+  JIF_t        left;
+  bool         limited;
+
+  SYS_ARCH_DECL_PROTECT(level);
+  WD_HIST_START(start);
+
+  p = tryAlloc(direction, size, &limited);
+  if (p != NULL || timeout == 0) {
+
+    count(direction, size, p, limited);
+    WD_HIST_END(WD_HIST_BUFFER_GET, start);
+    return p;
+  }
+
+  if (direction == WWD_NETWORK_TX)
+    ++bufStats.tx.waits;
+  else
+    ++bufStats.rx.waits;
+
+  deadline = jiffies + timeout;
+
+/*
+ * Register as waiter before retrying, so that a buffer freed between
+ * failed allocation and semaphore wait is not missed.
+ */
+  SYS_ARCH_PROTECT(level);
+  ++poolWaiters;
+  SYS_ARCH_UNPROTECT(level);
+
+  while (1) {
+
+    p = tryAlloc(direction, size, &limited);
+    if (p != NULL)
+      break;
+
+    if (timeout == INFINITE)
+      left = INFINITE;
+    else {
+
+      left = deadline - jiffies;
+      if (left == 0 || left > timeout)
+        break;
+    }
+
+    if (poolSema == NULL)
+      nosTaskSleep(1);
+    else if (limited)
+      nosSemaWait(poolSema, MIN((UINT_t)left, wdMsToTicks(WDCFG_BUFFER_LIMIT_WAIT)));
+    else
+      nosSemaWait(poolSema, POOL_WAIT_TICKS((UINT_t)left));
+  }
+
+  SYS_ARCH_PROTECT(level);
+  --poolWaiters;
+  SYS_ARCH_UNPROTECT(level);
+
+/*
+ * Hook fires only on empty -> non-empty transition. If there
+ * are more buffers available, pass the wakeup to next waiter.
+ */
+  if (p != NULL && poolWaiters > 0)
+    nosSemaSignal(poolSema);
+
+  count(direction, size, p, limited);
+  WD_HIST_END(WD_HIST_BUFFER_GET, start);
+  return p;
+}
+
 wwd_result_t host_buffer_get(wiced_buffer_t* buffer,
                              wwd_buffer_dir_t direction,
                              unsigned short size,
@@ -55,14 +246,7 @@ wwd_result_t host_buffer_get(wiced_buffer_t* buffer,
   if (size > WICED_LINK_MTU)
     return WWD_BUFFER_UNAVAILABLE_PERMANENT;
 
-  do {
-    
-    *buffer = pbuf_alloc(PBUF_RAW, size, PBUF_POOL);
-    if (wait && *buffer == NULL)
-      posTaskSleep(MS(1));
-
-  } while (wait && *buffer == NULL);
-
+  *buffer = poolAlloc(direction, size, wait ? INFINITE : 0);
   if (*buffer == NULL)
     return WWD_BUFFER_UNAVAILABLE_TEMPORARY;
     
@@ -80,24 +264,34 @@ wwd_result_t internal_host_buffer_get(wiced_buffer_t* buffer,
   if (size > WICED_LINK_MTU)
     return WWD_BUFFER_UNAVAILABLE_PERMANENT;
 
-  do {
-
-    *buffer = pbuf_alloc(PBUF_RAW, size, PBUF_POOL);
-    if (timeout && *buffer == NULL)
-      posTaskSleep(MS(1));
-
-  } while (timeout-- && *buffer == NULL);
-
+/*
+ * Timeout is in milliseconds.
+ */
+  *buffer = poolAlloc(direction, size, timeout ? wdMsToTicks(timeout) : 0);
   if (*buffer == NULL)
     return WWD_BUFFER_UNAVAILABLE_TEMPORARY;
 
   return WWD_SUCCESS;
 }
 
+void wdGetBufferStats(WdBufferStats* stats)
+{
+  *stats = bufStats;
+}
+
 void host_buffer_release(wiced_buffer_t buffer, wwd_buffer_dir_t direction)
 {
   P_ASSERT("pbuf valid", buffer != NULL);
+  WD_TRACE(WD_TRACE_BUF_RELEASE, (direction << 16) | buffer->tot_len);
   pbuf_free(buffer);
+
+/*
+ * Wake up waiter. Needed when it was refused because
+ * of reservation, as pool hook fires only when pool
+ * was empty.
+ */
+  if (poolWaiters > 0 && poolSema != NULL)
+    nosSemaSignal(poolSema);
 }
 
 uint8_t* host_buffer_get_current_piece_data_pointer(wiced_buffer_t buffer)
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+
+#include "wd_glue.h"
+
+#include "lwip/sys.h"
+
+/*
+ * Monotonic clock. Jiffies (extended to 64 bits) are the
+ * base, time within a tick comes from tick timer if port
+ * can read it (WD_CYCLES_SINCE_TICK). Otherwise cycle counter
+ * fills in time since the tick was first seen. Cycle counter
+ * may stop while MCU sleeps and wraps around, so it is never
+ * trusted over more than one tick. Counter is started on first
+ * read, so clock works even if wdSystemInit() is not used.
+ */
+
+static bool     started;
+static uint64_t cycles64;
+static uint64_t tickCycles64;
+static uint64_t jiffies64;
+static uint32_t lastCycles;
+static JIF_t    lastJiffies;
+static uint64_t lastUs;
+
+/*
+ * Update state from counters. Must be called
+ * with SYS_ARCH_PROTECT held.
+ */
+static void update(void)
+{
+  uint32_t now;
+  uint32_t delta;
+  JIF_t    jif;
+  JIF_t    ticks;
+  uint64_t expected;
+  uint64_t perTick = WD_CYCLES_PER_SEC / HZ;
+
+  if (!started) {
+
+    wdCyclesInit();
+    started      = true;
+    lastCycles   = wdCycles();
+    lastJiffies  = jiffies;
+    jiffies64    = lastJiffies;
+    cycles64     = jiffies64 * perTick;
+    tickCycles64 = cycles64;
+    return;
+  }
+
+  now   = wdCycles();
+  jif   = jiffies;
+  delta = now - lastCycles;
+  ticks = (JIF_t)(jif - lastJiffies);
+
+/*
+ * If counter is behind jiffies by more than one tick it has
+ * been stopped (sleep) or has wrapped, resync it to jiffies.
+ */
+  expected = (uint64_t)ticks * perTick;
+  if (expected > (uint64_t)delta + perTick)
+    cycles64 += expected - delta;
+
+  cycles64   += delta;
+  lastCycles  = now;
+
+  if (ticks != 0) {
+
+    jiffies64    += ticks;
+    lastJiffies   = jif;
+    tickCycles64  = cycles64;
+  }
+}
+
+uint64_t wdCycles64(void)
+{
+  uint64_t result;
+
+  SYS_ARCH_DECL_PROTECT(level);
+  SYS_ARCH_PROTECT(level);
+
+  update();
+  result = cycles64;
+
+  SYS_ARCH_UNPROTECT(level);
+  return result;
+}
+
+uint64_t wdTimeUs(void)
+{
+  uint64_t sub;
+  uint64_t jif;
+  uint64_t limit = 1000000 / HZ;
+  uint64_t us;
+#ifdef WD_CYCLES_SINCE_TICK
+  uint32_t since;
+  JIF_t    jif32;
+  bool     known;
+#endif
+
+  SYS_ARCH_DECL_PROTECT(level);
+  SYS_ARCH_PROTECT(level);
+
+  update();
+  jif = jiffies64;
+  sub = cycles64 - tickCycles64;
+
+#ifdef WD_CYCLES_SINCE_TICK
+
+/*
+ * Time since tick interrupt is exact, unlike time since
+ * tick was seen here. If tick is pending (jiffies not yet
+ * incremented) it can be up to two ticks. Read again
+ * if tick interrupt ran meanwhile.
+ */
+  do {
+
+    jif32 = jiffies;
+    known = wdCyclesSinceTick(&since);
+  } while (jif32 != jiffies);
+
+  if (known) {
+
+    jif   = jiffies64 + (JIF_t)(jif32 - lastJiffies);
+    sub   = since;
+    limit = 2 * 1000000 / HZ;
+  }
+
+#endif
+
+/*
+ * Sub-tick part is limited, so that time doesn't
+ * go backwards when next tick is seen.
+ */
+  sub = sub * 1000000 / WD_CYCLES_PER_SEC;
+  if (sub >= limit)
+    sub = limit - 1;
+
+  us = jif * 1000000 / HZ + sub;
+  if (us < lastUs)
+    us = lastUs;
+  else
+    lastUs = us;
+
+  SYS_ARCH_UNPROTECT(level);
+  return us;
+}
+
+uint32_t wdTimeMs(void)
+{
+  return (uint32_t)(wdTimeUs() / 1000);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "lwip/sys.h"
+
+#if WDCFG_LATENCY_HIST
+static WdHistogram histograms[WD_HIST_COUNT];
+
+/*
+ * Set by WWD_RTOS_MAP_ISR when interrupt is entered.
+ */
+volatile uint32_t wdIsrEntryCycles;
+#endif
+
+/*
+ * Add a sample to histogram. Bucket n holds
+ * values in range [2^(n-1), 2^n), bucket 0 holds zeros.
+ */
+#if WDCFG_LATENCY_HIST
+void wdHistogramAdd(WdHistogramId id, uint32_t cycles)
+{
+  WdHistogram* h = &histograms[id];
+  int          bucket;
+
+  SYS_ARCH_DECL_PROTECT(level);
+
+  bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+  if (bucket >= WD_HIST_BUCKETS)
+    bucket = WD_HIST_BUCKETS - 1;
+
+/*
+ * Samples are added from several tasks, and 64-bit
+ * total cannot be updated atomically.
+ */
+  SYS_ARCH_PROTECT(level);
+  ++h->bucket[bucket];
+  ++h->count;
+  h->total += cycles;
+  if (cycles > h->max)
+    h->max = cycles;
+
+  SYS_ARCH_UNPROTECT(level);
+}
+#endif
+
+void wdGetHistogram(WdHistogramId id, WdHistogram* hist)
+{
+#if WDCFG_LATENCY_HIST
+  SYS_ARCH_DECL_PROTECT(level);
+
+  P_ASSERT("valid histogram", id < WD_HIST_COUNT);
+  SYS_ARCH_PROTECT(level);
+  *hist = histograms[id];
+  SYS_ARCH_UNPROTECT(level);
+#else
+  memset(hist, '\0', sizeof(*hist));
+#endif
+}
+
+void wdResetHistograms(void)
+{
+#if WDCFG_LATENCY_HIST
+  SYS_ARCH_DECL_PROTECT(level);
+
+  SYS_ARCH_PROTECT(level);
+  memset(histograms, '\0', sizeof(histograms));
+  SYS_ARCH_UNPROTECT(level);
+#endif
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdbool.h>
+
+#include "wd_glue.h"
+
+#include "wwd_constants.h"
+#include "wwd_management.h"
+
+/*
+ * Firmware configuration made by driver (multicast lists,
+ * ARP offload, packet filters) is sent by a worker task, so that tcpip thread
+ * doesn't block waiting for iovar responses from WWD thread.
+ */
+#ifndef WDCFG_WORKER_PRIORITY
+#define WDCFG_WORKER_PRIORITY 1
+#endif
+
+/*
+ * Worker stack size, 0 means Pico]OS default.
+ */
+#ifndef WDCFG_WORKER_STACK_SIZE
+#define WDCFG_WORKER_STACK_SIZE 0
+#endif
+
+/*
+ * If firmware rejects an update, worker retries it after
+ * WDCFG_WORKER_RETRY ms, doubling the delay after each
+ * failure up to WDCFG_WORKER_RETRY_MAX ms.
+ */
+#ifndef WDCFG_WORKER_RETRY
+#define WDCFG_WORKER_RETRY 100
+#endif
+
+#ifndef WDCFG_WORKER_RETRY_MAX
+#define WDCFG_WORKER_RETRY_MAX 5000
+#endif
+
+static bool              workerStarted;
+static POSSEMA_t         workSema;
+static volatile uint32_t workPending;
+
+static void workerTask(void* arg)
+{
+  uint32_t work;
+  uint32_t failed  = 0;
+  UINT_t   backoff = 0;
+  UINT_t   max     = wdMsToTicks(WDCFG_WORKER_RETRY_MAX);
+
+  while (true) {
+
+/*
+ * Failed work is retried when backoff time has
+ * passed, or earlier if something new is posted.
+ */
+    nosSemaWait(workSema, failed ? backoff : INFINITE);
+
+    posTaskSchedLock();
+    work = workPending | failed;
+    workPending = 0;
+    posTaskSchedUnlock();
+
+    failed = 0;
+    if ((work & WD_WORK_MULTICAST) && !wdMulticastSync())
+      failed |= WD_WORK_MULTICAST;
+
+    if (work & WD_WORK_OFFLOAD)
+      wdOffloadSync();
+
+    if (failed == 0)
+      backoff = 0;
+    else if (backoff == 0)
+      backoff = wdMsToTicks(WDCFG_WORKER_RETRY);
+    else
+      backoff = (backoff < max / 2) ? backoff * 2 : max;
+  }
+}
+
+/*
+ * Start worker task if it is not running yet. Work
+ * posted before this is done when worker starts.
+ */
+void wdWorkerInit(void)
+{
+  bool      start;
+  NOSTASK_t task;
+
+  posTaskSchedLock();
+  start = !workerStarted;
+  workerStarted = true;
+  posTaskSchedUnlock();
+
+  if (!start)
+    return;
+
+  workSema = nosSemaCreate(0, 0, "wdwork");
+  P_ASSERT("wdWorkerInit: semaphore", workSema != NULL);
+
+  task = nosTaskCreate(workerTask, NULL, WDCFG_WORKER_PRIORITY, WDCFG_WORKER_STACK_SIZE, "wdwork");
+  P_ASSERT("wdWorkerInit: task", task != NULL);
+
+  if (workPending)
+    nosSemaSignal(workSema);
+}
+
+/*
+ * Ask worker to do something. Worker is woken up only
+ * when first item is posted after it has picked up previous
+ * ones, so repeated posts don't cause extra wakeups.
+ */
+void wdWorkerPost(uint32_t work)
+{
+  bool wake;
+
+  posTaskSchedLock();
+  wake = (workPending == 0);
+  workPending |= work;
+  posTaskSchedUnlock();
+
+  if (wake && workSema != NULL)
+    nosSemaSignal(workSema);
+}
+
+/*
+ * Initialize WWD and restore configuration that
+ * firmware lost when it was (re)started.
+ */
+wwd_result_t wdManagementInit(wiced_country_code_t country, void* bufferArg)
+{
+  wwd_result_t result;
+
+  wdWorkerInit();
+  result = wwd_management_init(country, bufferArg);
+  if (result != WWD_SUCCESS) {
+
+/*
+ * Download might have been aborted in the middle.
+ */
+    wdFirmwareRelease();
+    return result;
+  }
+
+  wdMulticastRestore();
+  wdOffloadRestore();
+  return WWD_SUCCESS;
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "wwd_constants.h"
+#include "wwd_structures.h"
+#include "internal/wwd_sdpcm.h"
+
+/*
+ * Multicast MAC tables, one per interface. Addresses are reference
+ * counted, as several IP groups can map to same MAC address. Whole
+ * table is written to firmware using single mcast_list iovar.
+ * If there are more addresses than firmware can hold,
+ * allmulti mode is enabled instead and unwanted frames
+ * are filtered in receive path. Firmware is updated by
+ * worker task (management.c), so tcpip thread doesn't block.
+ */
+#ifndef WDCFG_MCAST_TABLE_SIZE
+#define WDCFG_MCAST_TABLE_SIZE 32
+#endif
+
+/*
+ * Size of multicast list in firmware.
+ */
+#ifndef WDCFG_MCAST_HW_MAX
+#define WDCFG_MCAST_HW_MAX 10
+#endif
+
+#if WDCFG_MCAST_HW_MAX > WDCFG_MCAST_TABLE_SIZE
+#error WDCFG_MCAST_HW_MAX must not be larger than WDCFG_MCAST_TABLE_SIZE
+#endif
+
+typedef struct {
+
+  wiced_mac_t mac;
+  uint16_t    refs;
+} McastEntry;
+
+typedef struct {
+
+  McastEntry    entry[WDCFG_MCAST_TABLE_SIZE];
+  int           entries;
+  volatile bool hostFilter;
+  bool          fwAllMulti;
+  bool          dirty;
+} McastTable;
+
+static McastTable       tables[WD_INTERFACES];
+static WdMulticastStats stats;
+
+static int find(McastTable* t, const uint8_t* mac)
+{
+  int i;
+
+  for (i = 0; i < t->entries; i++)
+    if (memcmp(t->entry[i].mac.octet, mac, sizeof(wiced_mac_t)) == 0)
+      return i;
+
+  return -1;
+}
+
+static wwd_result_t setAllMulti(wwd_interface_t interface, bool on)
+{
+  wiced_buffer_t buffer;
+  uint32_t*      data;
+  wwd_result_t   result;
+
+  data = wwd_sdpcm_get_iovar_buffer(&buffer, sizeof(uint32_t), "allmulti");
+  if (data == NULL)
+    return WWD_BUFFER_UNAVAILABLE_TEMPORARY;
+
+  *data  = on ? 1 : 0;
+  result = wwd_sdpcm_send_iovar(SDPCM_SET, buffer, NULL, interface);
+  if (result == WWD_SUCCESS) {
+
+    tables[interface].fwAllMulti = on;
+    ++stats.fwUpdates;
+  }
+
+  return result;
+}
+
+/*
+ * Write multicast list to firmware.
+ */
+static wwd_result_t setList(wwd_interface_t interface, const wiced_mac_t* list, int count)
+{
+  wiced_buffer_t buffer;
+  uint32_t*      data;
+  wwd_result_t   result;
+
+  data  = wwd_sdpcm_get_iovar_buffer(&buffer,
+                                     sizeof(uint32_t) + WDCFG_MCAST_HW_MAX * sizeof(wiced_mac_t),
+                                     "mcast_list");
+  if (data == NULL)
+    return WWD_BUFFER_UNAVAILABLE_TEMPORARY;
+
+  data[0] = count;
+  memcpy(data + 1, list, count * sizeof(wiced_mac_t));
+
+  result = wwd_sdpcm_send_iovar(SDPCM_SET, buffer, NULL, interface);
+  if (result == WWD_SUCCESS)
+    ++stats.fwUpdates;
+
+  return result;
+}
+
+/*
+ * Bring firmware state of interface up to date with table.
+ * Order of operations ensures that wanted frames are
+ * not lost while switching to/from allmulti mode.
+ * Returns false if firmware update failed.
+ */
+static bool syncInterface(wwd_interface_t interface)
+{
+  McastTable*  t = &tables[interface];
+  wiced_mac_t  list[WDCFG_MCAST_HW_MAX];
+  wwd_result_t result = WWD_SUCCESS;
+  bool         all;
+  int          count;
+  int          i;
+
+  posTaskSchedLock();
+  if (!t->dirty) {
+
+    posTaskSchedUnlock();
+    return true;
+  }
+
+  t->dirty = false;
+  all      = t->entries > WDCFG_MCAST_HW_MAX;
+  count    = all ? 0 : t->entries;
+  for (i = 0; i < count; i++)
+    list[i] = t->entry[i].mac;
+
+  posTaskSchedUnlock();
+
+  if (all) {
+
+    t->hostFilter = true;
+    if (!t->fwAllMulti)
+      result = setAllMulti(interface, true);
+
+    if (result == WWD_SUCCESS)
+      result = setList(interface, list, count);
+  }
+  else {
+
+    result = setList(interface, list, count);
+    if (result == WWD_SUCCESS && t->fwAllMulti)
+      result = setAllMulti(interface, false);
+
+    if (result == WWD_SUCCESS)
+      t->hostFilter = false;
+  }
+
+  if (result != WWD_SUCCESS) {
+
+    ++stats.fwErrors;
+    t->dirty = true;
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Called by worker task. Returns false if some
+ * table is still waiting to be written.
+ */
+bool wdMulticastSync(void)
+{
+  bool ok = true;
+  int  i;
+
+  for (i = 0; i < WD_INTERFACES; i++)
+    if (!syncInterface((wwd_interface_t)i))
+      ok = false;
+
+  return ok;
+}
+
+/*
+ * Called after WWD has been (re)initialized. Firmware
+ * has lost its multicast configuration, so write all
+ * non-empty tables again.
+ */
+void wdMulticastRestore(void)
+{
+  bool post = false;
+  int  i;
+
+  posTaskSchedLock();
+  for (i = 0; i < WD_INTERFACES; i++) {
+
+    tables[i].fwAllMulti = false;
+    if (tables[i].entries > 0) {
+
+      tables[i].dirty = true;
+      post = true;
+    }
+  }
+
+  posTaskSchedUnlock();
+
+  if (post)
+    wdWorkerPost(WD_WORK_MULTICAST);
+}
+
+/*
+ * Schedule firmware update. Changes made before
+ * worker gets to run are written using single update.
+ */
+static void scheduleSync(McastTable* t)
+{
+  t->dirty = true;
+  wdWorkerPost(WD_WORK_MULTICAST);
+}
+
+err_t wdMulticastJoin(wwd_interface_t interface, const uint8_t* mac)
+{
+  McastTable* t = &tables[interface];
+  int         i;
+
+  ++stats.joins;
+  i = find(t, mac);
+  if (i >= 0) {
+
+    ++t->entry[i].refs;
+    return ERR_OK;
+  }
+
+  if (t->entries >= WDCFG_MCAST_TABLE_SIZE) {
+
+    ++stats.tableFull;
+    return ERR_MEM;
+  }
+
+  posTaskSchedLock();
+  memcpy(t->entry[t->entries].mac.octet, mac, sizeof(wiced_mac_t));
+  t->entry[t->entries].refs = 1;
+  ++t->entries;
+  scheduleSync(t);
+  posTaskSchedUnlock();
+
+  return ERR_OK;
+}
+
+err_t wdMulticastLeave(wwd_interface_t interface, const uint8_t* mac)
+{
+  McastTable* t = &tables[interface];
+  int         i;
+
+  ++stats.leaves;
+  i = find(t, mac);
+  if (i < 0)
+    return ERR_VAL;
+
+  if (--t->entry[i].refs > 0)
+    return ERR_OK;
+
+  posTaskSchedLock();
+  --t->entries;
+  t->entry[i] = t->entry[t->entries];
+  scheduleSync(t);
+  posTaskSchedUnlock();
+
+  return ERR_OK;
+}
+
+/*
+ * Called from receive path for multicast frames.
+ * Filtering is needed only when firmware passes all
+ * multicast frames to host.
+ */
+bool wdMulticastAccept(wwd_interface_t interface, const uint8_t* mac)
+{
+  McastTable* t = &tables[interface];
+  bool        found;
+
+  if (!t->hostFilter)
+    return true;
+
+  posTaskSchedLock();
+  found = find(t, mac) >= 0;
+  posTaskSchedUnlock();
+
+  if (!found)
+    ++stats.hostDropped;
+
+  return found;
+}
+
+void wdGetMulticastStats(WdMulticastStats* st)
+{
+  int i;
+
+  posTaskSchedLock();
+  *st = stats;
+  st->entries  = 0;
+  st->allMulti = 0;
+  for (i = 0; i < WD_INTERFACES; i++) {
+
+    st->entries += tables[i].entries;
+    if (tables[i].fwAllMulti)
+      st->allMulti = 1;
+  }
+
+  posTaskSchedUnlock();
+}
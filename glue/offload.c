@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "lwip/netif.h"
+#include "lwip/prot/ethernet.h"
+
+#include "wwd_constants.h"
+#include "wwd_structures.h"
+#include "wwd_wifi.h"
+#include "internal/wwd_sdpcm.h"
+
+/*
+ * Firmware offloads that keep MCU sleeping: ARP requests
+ * for our address are answered by firmware and frames
+ * that host would not process anyway are discarded
+ * by firmware packet filter.
+ */
+
+/*
+ * ARP offload modes for arp_ol iovar.
+ */
+#define ARP_OL_AGENT           0x00000001
+#define ARP_OL_SNOOP           0x00000002
+#define ARP_OL_HOST_AUTO_REPLY 0x00000004
+#define ARP_OL_PEER_AUTO_REPLY 0x00000008
+
+#ifndef WDCFG_ARP_OFFLOAD_MODE
+#define WDCFG_ARP_OFFLOAD_MODE (ARP_OL_AGENT | ARP_OL_SNOOP | ARP_OL_HOST_AUTO_REPLY)
+#endif
+
+/*
+ * First id used for firmware packet filters.
+ */
+#ifndef WDCFG_PACKET_FILTER_ID
+#define WDCFG_PACKET_FILTER_ID 100
+#endif
+
+#if WDCFG_ARP_OFFLOAD && !LWIP_NETIF_EXT_STATUS_CALLBACK
+#error "WDCFG_ARP_OFFLOAD needs LWIP_NETIF_EXT_STATUS_CALLBACK to keep firmware address in sync."
+#endif
+
+/*
+ * Max number of ethertypes passed by packet filter.
+ */
+#define FILTER_TYPES 8
+
+static WdOffloadStats stats;
+volatile uint32_t     wdBusWakeups;
+
+/*
+ * State wanted in firmware. It is set in tcpip thread from
+ * netif and written to firmware by worker task (management.c).
+ */
+static bool              active;
+static volatile bool     initPending;
+static volatile uint32_t wantedIp;
+
+#if WDCFG_ARP_OFFLOAD
+
+static uint32_t hostIp;
+
+static wwd_result_t setIovar(const char* name, const void* value, uint16_t len)
+{
+  wiced_buffer_t buffer;
+  void*          data;
+
+  data = wwd_sdpcm_get_iovar_buffer(&buffer, len, name);
+  if (data == NULL)
+    return WWD_BUFFER_UNAVAILABLE_TEMPORARY;
+
+  if (len > 0)
+    memcpy(data, value, len);
+
+  return wwd_sdpcm_send_iovar(SDPCM_SET, buffer, NULL, WWD_STA_INTERFACE);
+}
+
+static wwd_result_t setIovarU32(const char* name, uint32_t value)
+{
+  return setIovar(name, &value, sizeof(value));
+}
+
+/*
+ * Keep firmware ARP host address in sync with netif.
+ */
+static void arpUpdate(uint32_t ip)
+{
+  wwd_result_t result;
+
+  if (ip == hostIp)
+    return;
+
+  result = setIovar("arp_hostip_clear", NULL, 0);
+  if (result == WWD_SUCCESS && ip != IPADDR_ANY)
+    result = setIovarU32("arp_hostip", ip);
+
+  if (result != WWD_SUCCESS) {
+
+    ++stats.fwErrors;
+    return;
+  }
+
+  hostIp = ip;
+  ++stats.arpHostIpUpdates;
+}
+
+static void arpInit(void)
+{
+  stats.arpOffload = 0;
+  if (setIovarU32("arp_ol", WDCFG_ARP_OFFLOAD_MODE) != WWD_SUCCESS ||
+      setIovarU32("arpoe", 1) != WWD_SUCCESS) {
+
+    ++stats.fwErrors;
+    return;
+  }
+
+  hostIp = IPADDR_ANY;
+  stats.arpOffload = 1;
+}
+
+#endif
+
+#if WDCFG_PACKET_FILTER
+
+static uint16_t filterTypes[FILTER_TYPES];
+static int      filterTypeCount;
+
+/*
+ * Collect ethertypes that netif needs. If application
+ * handles other ethertypes itself (LWIP_HOOK_UNKNOWN_ETH_PROTOCOL),
+ * list is left empty and no filters are installed.
+ */
+static int filterTypesFor(struct netif* netif, uint16_t* types)
+{
+  int count = 0;
+
+#ifdef LWIP_HOOK_UNKNOWN_ETH_PROTOCOL
+  return 0;
+#endif
+
+  if (!(netif->flags & NETIF_FLAG_ETHERNET) && !(netif->flags & NETIF_FLAG_ETHARP))
+    return 0;
+
+#if LWIP_IPV4
+  types[count++] = ETHTYPE_IP;
+  if (netif->flags & NETIF_FLAG_ETHARP)
+    types[count++] = ETHTYPE_ARP;
+#endif
+
+#if LWIP_IPV6
+  types[count++] = ETHTYPE_IPV6;
+#endif
+
+#if PPPOE_SUPPORT
+  types[count++] = ETHTYPE_PPPOEDISC;
+  types[count++] = ETHTYPE_PPPOE;
+#endif
+
+  types[count++] = 0x888e;       // EAPOL, handled by WWD
+  return count;
+}
+
+/*
+ * Install firmware filters that pass only ethertypes
+ * this netif needs.
+ */
+static void filterInit(void)
+{
+  static const uint8_t   mask[2] = { 0xff, 0xff };
+  uint16_t               types[FILTER_TYPES];
+  uint8_t                pattern[2];
+  wiced_packet_filter_t  filter;
+  int                    count;
+  int                    i;
+  wwd_result_t           result;
+
+  posTaskSchedLock();
+  count = filterTypeCount;
+  memcpy(types, filterTypes, sizeof(types));
+  posTaskSchedUnlock();
+
+  stats.packetFilters = 0;
+  if (count == 0)
+    return;
+
+  for (i = 0; i < count; i++) {
+
+    pattern[0] = types[i] >> 8;
+    pattern[1] = types[i] & 0xff;
+
+    memset(&filter, '\0', sizeof(filter));
+    filter.id             = WDCFG_PACKET_FILTER_ID + i;
+    filter.rule           = WICED_PACKET_FILTER_RULE_POSITIVE_MATCHING;
+    filter.offset         = 12;
+    filter.mask_size      = sizeof(mask);
+    filter.mask           = (uint8_t*)mask;
+    filter.pattern        = pattern;
+
+    wwd_wifi_remove_packet_filter(filter.id);
+    result = wwd_wifi_add_packet_filter(&filter);
+    if (result == WWD_SUCCESS)
+      result = wwd_wifi_enable_packet_filter(filter.id);
+
+    if (result != WWD_SUCCESS) {
+
+      ++stats.fwErrors;
+      return;
+    }
+  }
+
+  if (wwd_wifi_set_packet_filter_mode(WICED_PACKET_FILTER_MODE_FORWARD) != WWD_SUCCESS) {
+
+    ++stats.fwErrors;
+    return;
+  }
+
+  stats.packetFilters = i;
+}
+
+#endif
+
+/*
+ * Called by worker task to bring firmware up to date.
+ */
+void wdOffloadSync(void)
+{
+  if (initPending) {
+
+    initPending = false;
+
+#if WDCFG_ARP_OFFLOAD
+    arpInit();
+#endif
+
+#if WDCFG_PACKET_FILTER
+    filterInit();
+#endif
+  }
+
+#if WDCFG_ARP_OFFLOAD
+  if (stats.arpOffload)
+    arpUpdate(wantedIp);
+#endif
+}
+
+/*
+ * Called in tcpip thread when netif is initialized.
+ */
+void wdOffloadInit(struct netif* netif)
+{
+  if ((wwd_interface_t)netif->state != WWD_STA_INTERFACE)
+    return;
+
+#if WDCFG_ARP_OFFLOAD || WDCFG_PACKET_FILTER
+
+  posTaskSchedLock();
+#if WDCFG_PACKET_FILTER
+  filterTypeCount = filterTypesFor(netif, filterTypes);
+#endif
+  wantedIp    = ip4_addr_get_u32(netif_ip4_addr(netif));
+  active      = true;
+  initPending = true;
+  posTaskSchedUnlock();
+
+  wdWorkerPost(WD_WORK_OFFLOAD);
+
+#endif
+}
+
+/*
+ * Called in tcpip thread when netif IPv4 address changes.
+ */
+void wdOffloadAddressChanged(struct netif* netif)
+{
+#if WDCFG_ARP_OFFLOAD
+  if ((wwd_interface_t)netif->state == WWD_STA_INTERFACE) {
+
+    wantedIp = ip4_addr_get_u32(netif_ip4_addr(netif));
+    wdWorkerPost(WD_WORK_OFFLOAD);
+  }
+#endif
+}
+
+/*
+ * Called in tcpip thread when netif is removed.
+ */
+void wdOffloadRemoved(struct netif* netif)
+{
+  if ((wwd_interface_t)netif->state == WWD_STA_INTERFACE)
+    active = false;
+}
+
+/*
+ * Called after WWD has been (re)initialized,
+ * firmware has lost offload configuration.
+ */
+void wdOffloadRestore(void)
+{
+  if (!active)
+    return;
+
+  initPending = true;
+  wdWorkerPost(WD_WORK_OFFLOAD);
+}
+
+void wdGetOffloadStats(WdOffloadStats* st)
+{
+  *st = stats;
+  st->busWakeups = wdBusWakeups;
+}
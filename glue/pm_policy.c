@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "wwd_constants.h"
+#include "wwd_wifi.h"
+
+/*
+ * Power-save policy. Application calls wdPowersavePolicyRun()
+ * periodically, policy looks at frame rate since previous
+ * call and transmit queue depth and selects one of
+ *
+ * - WD_PM_ACTIVE:     PM0 (no power save), MCU sleep disabled
+ * - WD_PM_THROUGHPUT: PM2 (power save with throughput), MCU sleep disabled
+ * - WD_PM_SLEEP:      PM1 (power save), MCU sleep enabled
+ *
+ * Moving to a more active state happens immediately when
+ * enter threshold is reached. Moving to less active state
+ * requires rate to stay below exit threshold for
+ * WDCFG_PM_DWELL consecutive runs.
+ */
+
+/*
+ * Thresholds in frames per second (tx + rx).
+ */
+#ifndef WDCFG_PM_ACTIVE_ENTER
+#define WDCFG_PM_ACTIVE_ENTER 50
+#endif
+
+#ifndef WDCFG_PM_ACTIVE_EXIT
+#define WDCFG_PM_ACTIVE_EXIT 20
+#endif
+
+#ifndef WDCFG_PM_THROUGHPUT_ENTER
+#define WDCFG_PM_THROUGHPUT_ENTER 5
+#endif
+
+#ifndef WDCFG_PM_THROUGHPUT_EXIT
+#define WDCFG_PM_THROUGHPUT_EXIT 1
+#endif
+
+#ifndef WDCFG_PM_DWELL
+#define WDCFG_PM_DWELL 3
+#endif
+
+/*
+ * Time to stay awake after traffic in PM2 (ms).
+ */
+#ifndef WDCFG_PM2_SLEEP_DELAY
+#define WDCFG_PM2_SLEEP_DELAY 100
+#endif
+
+#if WDCFG_PM_ACTIVE_EXIT > WDCFG_PM_ACTIVE_ENTER || WDCFG_PM_THROUGHPUT_EXIT > WDCFG_PM_THROUGHPUT_ENTER
+#error Power-save exit threshold must not be above enter threshold
+#endif
+
+static WdPowersaveStats stats;
+static bool             started;
+static WdPmState        state;
+static int              downCount;
+static uint32_t         lastTx;
+static uint32_t         lastRx;
+static JIF_t            lastRun;
+static JIF_t            stateEntered;
+static bool             mcuSleep;
+
+/*
+ * Select state from traffic. Kept free of side effects
+ * so that it can be exercised with recorded traffic.
+ */
+WdPmState wdPowersaveDecide(WdPmState current, uint32_t rate, uint32_t queued, int* down)
+{
+  WdPmState wanted;
+
+  if (queued > 0 || rate >= WDCFG_PM_ACTIVE_ENTER)
+    wanted = WD_PM_ACTIVE;
+  else if (rate >= WDCFG_PM_THROUGHPUT_ENTER)
+    wanted = WD_PM_THROUGHPUT;
+  else
+    wanted = WD_PM_SLEEP;
+
+  if (wanted <= current) {
+
+    *down = 0;
+    return wanted;
+  }
+
+/*
+ * Less active state wanted, check exit threshold
+ * of current state.
+ */
+  if (current == WD_PM_ACTIVE && rate >= WDCFG_PM_ACTIVE_EXIT) {
+
+    *down = 0;
+    return current;
+  }
+
+  if (current == WD_PM_THROUGHPUT && rate >= WDCFG_PM_THROUGHPUT_EXIT) {
+
+    *down = 0;
+    return current;
+  }
+
+  if (++*down < WDCFG_PM_DWELL)
+    return current;
+
+  *down = 0;
+  return current + 1;
+}
+
+static void setMcuSleep(bool on)
+{
+  if (on == mcuSleep)
+    return;
+
+#if POSCFG_FEATURE_POWER
+  if (on)
+    posPowerEnableSleep();
+  else
+    posPowerDisableSleep();
+#endif
+
+  mcuSleep = on;
+}
+
+static wwd_result_t apply(WdPmState next)
+{
+  wwd_result_t result;
+
+  switch (next) {
+  case WD_PM_ACTIVE:
+    setMcuSleep(false);
+    result = wwd_wifi_disable_powersave();
+    break;
+
+  case WD_PM_THROUGHPUT:
+    setMcuSleep(false);
+    result = wwd_wifi_enable_powersave_with_throughput(WDCFG_PM2_SLEEP_DELAY);
+    break;
+
+  default:
+    result = wwd_wifi_enable_powersave();
+    if (result == WWD_SUCCESS)
+      setMcuSleep(true);
+
+    break;
+  }
+
+  return result;
+}
+
+WdPmState wdPowersavePolicyRun(void)
+{
+  JIF_t     now = jiffies;
+  uint32_t  tx  = wdTraffic.txFrames;
+  uint32_t  rx  = wdTraffic.rxFrames;
+  uint32_t  elapsed;
+  uint32_t  rate;
+  WdPmState next;
+
+  if (!started) {
+
+/*
+ * Start from active state. Application may have
+ * changed firmware or MCU power save before policy
+ * was started, so active state is applied. If that
+ * fails, start is tried again on next run.
+ */
+    if (apply(WD_PM_ACTIVE) != WWD_SUCCESS) {
+
+      ++stats.fwErrors;
+      return WD_PM_ACTIVE;
+    }
+
+    started      = true;
+    state        = WD_PM_ACTIVE;
+    lastTx       = tx;
+    lastRx       = rx;
+    lastRun      = now;
+    stateEntered = now;
+    ++stats.enter[state];
+    return state;
+  }
+
+  elapsed = (uint32_t)(now - lastRun);
+  if (elapsed == 0)
+    return state;
+
+  rate    = (uint32_t)(((uint64_t)(tx - lastTx) + (rx - lastRx)) * HZ / elapsed);
+  lastTx  = tx;
+  lastRx  = rx;
+  lastRun = now;
+
+  ++stats.runs;
+  stats.rate = rate;
+
+  next = wdPowersaveDecide(state, rate, wdTxQueueDepth(), &downCount);
+  if (next == state)
+    return state;
+
+  if (apply(next) != WWD_SUCCESS) {
+
+    ++stats.fwErrors;
+    return state;
+  }
+
+  stats.time[state] += wdTicksToMs(now - stateEntered);
+  stateEntered = now;
+  state        = next;
+
+  ++stats.transitions;
+  ++stats.enter[state];
+  return state;
+}
+
+void wdGetPowersaveStats(WdPowersaveStats* st)
+{
+  *st = stats;
+  st->state = state;
+  if (started)
+    st->time[state] += wdTicksToMs(jiffies - stateEntered);
+}
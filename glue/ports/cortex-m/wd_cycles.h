@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#ifndef _WD_CYCLES_H
+#define _WD_CYCLES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "platform_cmsis.h"
+
+/*
+ * Free-running cycle counter, DWT CYCCNT.
+ * Counts CPU clock cycles and wraps around at 32 bits.
+ */
+#define WD_CYCLES_PER_SEC SystemCoreClock
+
+static inline void wdCyclesInit(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t wdCycles(void)
+{
+  return DWT->CYCCNT;
+}
+
+/*
+ * CPU cycles since SysTick interrupt counted by jiffies.
+ * If SysTick interrupt is pending jiffies don't include it yet,
+ * counter is read again in case it wrapped during first read.
+ * SysTick external clock is assumed to be HCLK/8 (STM32).
+ * Returns false if SysTick is not running.
+ */
+#define WD_CYCLES_SINCE_TICK 1
+
+static inline bool wdCyclesSinceTick(uint32_t* cycles)
+{
+  uint32_t load = SysTick->LOAD + 1;
+  uint32_t val  = SysTick->VAL;
+  bool     late = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+  uint32_t elapsed;
+
+  if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk))
+    return false;
+
+  if (late)
+    val = SysTick->VAL;
+
+  elapsed = load - val + (late ? load : 0);
+  if (!(SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk))
+    elapsed *= 8;
+
+  *cycles = elapsed;
+  return true;
+}
+
+#endif /* _WD_CYCLES_H */
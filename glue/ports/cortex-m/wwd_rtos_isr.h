@@ -29,6 +29,24 @@
 #define _WWD_RTOS_ISR_H
 
 #include "wwd_rtos.h"
+#include "wd_trace.h"
+
+/*
+ * Interrupt entry time for WWD wakeup latency histogram.
+ */
+#if defined(WDCFG_LATENCY_HIST) && WDCFG_LATENCY_HIST
+
+#include "wd_cycles.h"
+
+extern volatile uint32_t wdIsrEntryCycles;
+
+#define WD_ISR_ENTER() wdIsrEntryCycles = wdCycles()
+
+#else
+
+#define WD_ISR_ENTER() do {} while (0)
+
+#endif
 
 /*
  * Declare interrupt handler "body" function.
@@ -40,7 +58,9 @@
  * so that Pico]OS enter/exit functions are called.
  */
 #define WWD_RTOS_MAP_ISR(function, isr) void isr(void) { \
+                                            WD_ISR_ENTER(); \
                                             c_pos_intEnter(); \
+                                            WD_TRACE(WD_TRACE_ISR, 0); \
                                             function(); \
                                             c_pos_intExitQuick(); \
                                           }
@@ -0,0 +1,672 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "wd_glue.h"
+#include "wd_sim.h"
+
+#include "lwip/pbuf.h"
+
+#include "wwd_constants.h"
+#include "wwd_structures.h"
+#include "wwd_wifi.h"
+#include "wwd_management.h"
+#include "network/wwd_network_interface.h"
+#include "network/wwd_buffer_interface.h"
+#include "internal/wwd_sdpcm.h"
+#include "RTOS/wwd_rtos_interface.h"
+#include "wwd_rtos_isr.h"
+
+/*
+ * Stand-in for WWD management, SDPCM and bus layers
+ * on host port. Only functions used by glue are provided.
+ */
+
+/*
+ * Space reserved in front of received frame, like
+ * bus and SDPCM headers on real hardware.
+ */
+#define SIM_RX_HEADER 16
+
+/*
+ * Largest iovar request accepted and number of
+ * different iovars whose last value is remembered.
+ */
+#define SIM_IOVAR_MAX   256
+#define SIM_IOVAR_NAMES 16
+
+/*
+ * Packet filters remembered.
+ */
+#define SIM_FILTERS     8
+
+/*
+ * Received frames waiting for sim task.
+ */
+#define SIM_BUS_FRAMES  32
+
+/*
+ * Length of ARP frame and ARP agent bit
+ * of arp_ol iovar.
+ */
+#define SIM_ARP_LEN       42
+#define SIM_ARP_OL_AGENT  0x01
+
+typedef struct {
+
+  const char*     name;
+  wwd_interface_t interface;
+  uint16_t        len;
+  uint8_t         data[SIM_IOVAR_MAX];
+} SimIovar;
+
+typedef struct {
+
+  bool     used;
+  bool     enabled;
+  uint8_t  id;
+  uint16_t offset;
+  uint8_t  size;
+  uint8_t  pattern[2];
+} SimFilter;
+
+static const uint8_t simMac[]  = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+static const uint8_t peerMac[] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+volatile uint64_t    wdSimCyclesStopped;
+volatile uint64_t    wdSimCyclesLost;
+
+static WdSimStats    stats;
+static WdSimTxHook   txHook;
+static volatile bool simReady = true;
+static volatile bool loopback;
+
+static volatile uint32_t rxRate;
+static uint16_t          rxLen = 64;
+static uint16_t          rxType = 0x0800;
+static uint8_t           rxDst[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static SimIovar          iovars[SIM_IOVAR_NAMES];
+static SimIovar          iovarReq;
+static volatile int      iovarFailures;
+static SimFilter         filters[SIM_FILTERS];
+static bool              filterForward;
+static uint8_t           txFrame[WICED_LINK_MTU];
+
+static host_semaphore_type_t busSema;
+static wiced_buffer_t    busFrames[SIM_BUS_FRAMES];
+static wwd_interface_t   busInterfaces[SIM_BUS_FRAMES];
+static uint32_t          busHead;
+static uint32_t          busTail;
+
+static void loopFrame(wiced_buffer_t buffer, wwd_interface_t interface);
+
+/*
+ * Transmit path.
+ */
+wwd_result_t wwd_network_send_ethernet_data(wiced_buffer_t buffer, wwd_interface_t interface)
+{
+  ++stats.txFrames;
+  stats.txBytes += buffer->tot_len;
+
+  if (txHook != NULL) {
+
+    u16_t len = pbuf_copy_partial(buffer, txFrame, sizeof(txFrame), 0);
+    txHook(txFrame, len);
+  }
+
+  if (loopback)
+    loopFrame(buffer, interface);
+
+  host_buffer_release(buffer, WWD_NETWORK_TX);
+  return WWD_SUCCESS;
+}
+
+wwd_result_t wwd_wifi_is_ready_to_transceive(wwd_interface_t interface)
+{
+  return simReady ? WWD_SUCCESS : WWD_NOTUP;
+}
+
+wwd_result_t wwd_wifi_get_mac_address(wiced_mac_t* mac, wwd_interface_t interface)
+{
+  memcpy(mac->octet, simMac, sizeof(simMac));
+  mac->octet[5] += interface;
+  return WWD_SUCCESS;
+}
+
+/*
+ * Firmware is always up in simulation. Like WWD,
+ * initialize buffer interface here. Firmware
+ * restart forgets all iovar values.
+ */
+wwd_result_t wwd_management_init(wiced_country_code_t country, void* bufferArg)
+{
+  ++stats.inits;
+
+  posTaskSchedLock();
+  memset(iovars, '\0', sizeof(iovars));
+  memset(filters, '\0', sizeof(filters));
+  filterForward = false;
+  posTaskSchedUnlock();
+
+  return wwd_buffer_init(bufferArg);
+}
+
+/*
+ * Firmware configuration requests are accepted
+ * and counted. Last value of each iovar is remembered,
+ * so that tests can check what driver has written.
+ */
+void* wwd_sdpcm_get_iovar_buffer(wiced_buffer_t* buffer, uint16_t len, const char* name)
+{
+  *buffer = NULL;
+  if (len > sizeof(iovarReq.data))
+    return NULL;
+
+  iovarReq.name = name;
+  iovarReq.len  = len;
+  return iovarReq.data;
+}
+
+static SimIovar* iovarFind(const char* name, wwd_interface_t interface, bool add)
+{
+  int i;
+
+  for (i = 0; i < SIM_IOVAR_NAMES && iovars[i].name != NULL; i++)
+    if (strcmp(iovars[i].name, name) == 0 && iovars[i].interface == interface)
+      return &iovars[i];
+
+  return (add && i < SIM_IOVAR_NAMES) ? &iovars[i] : NULL;
+}
+
+wwd_result_t wwd_sdpcm_send_iovar(sdpcm_command_type_t type,
+                                  wiced_buffer_t buffer,
+                                  wiced_buffer_t* response,
+                                  wwd_interface_t interface)
+{
+  SimIovar* var;
+
+  ++stats.iovars;
+  if (type == SDPCM_SET && iovarFailures > 0) {
+
+    --iovarFailures;
+    return WWD_TIMEOUT;
+  }
+
+  if (type == SDPCM_SET) {
+
+    posTaskSchedLock();
+    iovarReq.interface = interface;
+    var = iovarFind(iovarReq.name, interface, true);
+    if (var != NULL)
+      *var = iovarReq;
+
+    if (strcmp(iovarReq.name, "arp_hostip_clear") == 0) {
+
+      var = iovarFind("arp_hostip", interface, false);
+      if (var != NULL)
+        var->len = 0;
+    }
+
+    posTaskSchedUnlock();
+  }
+
+  return WWD_SUCCESS;
+}
+
+void wdSimFailIovars(int count)
+{
+  iovarFailures = count;
+}
+
+int wdSimGetIovar(const char* name, int interface, void* buf, int size)
+{
+  SimIovar* var;
+  int       len = -1;
+
+  posTaskSchedLock();
+  var = iovarFind(name, (wwd_interface_t)interface, false);
+  if (var != NULL) {
+
+    len = (size < var->len) ? size : var->len;
+    memcpy(buf, var->data, len);
+  }
+
+  posTaskSchedUnlock();
+  return len;
+}
+
+wwd_result_t wwd_wifi_enable_powersave(void)
+{
+  ++stats.iovars;
+  return WWD_SUCCESS;
+}
+
+wwd_result_t wwd_wifi_enable_powersave_with_throughput(uint16_t delay)
+{
+  ++stats.iovars;
+  return WWD_SUCCESS;
+}
+
+wwd_result_t wwd_wifi_disable_powersave(void)
+{
+  ++stats.iovars;
+  return WWD_SUCCESS;
+}
+
+/*
+ * Packet filters are remembered so that tests can
+ * check which ethertypes firmware would pass.
+ */
+static SimFilter* filterFind(uint8_t id)
+{
+  int i;
+
+  for (i = 0; i < SIM_FILTERS; i++)
+    if (filters[i].used && filters[i].id == id)
+      return &filters[i];
+
+  return NULL;
+}
+
+wwd_result_t wwd_wifi_add_packet_filter(const wiced_packet_filter_t* settings)
+{
+  SimFilter* f;
+  int        i;
+
+  ++stats.iovars;
+  if (filterFind(settings->id) != NULL || settings->mask_size > sizeof(f->pattern))
+    return WWD_BADARG;
+
+  for (i = 0; i < SIM_FILTERS && filters[i].used; i++);
+  if (i == SIM_FILTERS)
+    return WWD_BUFFER_UNAVAILABLE_PERMANENT;
+
+  f = &filters[i];
+  memset(f, '\0', sizeof(*f));
+  f->used   = true;
+  f->id     = settings->id;
+  f->offset = settings->offset;
+  f->size   = settings->mask_size;
+  memcpy(f->pattern, settings->pattern, settings->mask_size);
+  return WWD_SUCCESS;
+}
+
+wwd_result_t wwd_wifi_remove_packet_filter(uint8_t id)
+{
+  SimFilter* f = filterFind(id);
+
+  ++stats.iovars;
+  if (f == NULL)
+    return WWD_DOES_NOT_EXIST;
+
+  f->used = false;
+  return WWD_SUCCESS;
+}
+
+wwd_result_t wwd_wifi_enable_packet_filter(uint8_t id)
+{
+  SimFilter* f = filterFind(id);
+
+  ++stats.iovars;
+  if (f == NULL)
+    return WWD_DOES_NOT_EXIST;
+
+  f->enabled = true;
+  return WWD_SUCCESS;
+}
+
+wwd_result_t wwd_wifi_set_packet_filter_mode(wiced_packet_filter_mode_t mode)
+{
+  ++stats.iovars;
+  filterForward = (mode == WICED_PACKET_FILTER_MODE_FORWARD);
+  return WWD_SUCCESS;
+}
+
+int wdSimGetPacketFilters(uint16_t* types, int max)
+{
+  int count = 0;
+  int i;
+
+  if (!filterForward)
+    return 0;
+
+  for (i = 0; i < SIM_FILTERS && count < max; i++)
+    if (filters[i].used && filters[i].enabled && filters[i].offset == 12 && filters[i].size == 2)
+      types[count++] = (filters[i].pattern[0] << 8) | filters[i].pattern[1];
+
+  return count;
+}
+
+static uint32_t iovarU32(const SimIovar* var)
+{
+  uint32_t value = 0;
+
+  if (var != NULL && var->len == sizeof(value))
+    memcpy(&value, var->data, sizeof(value));
+
+  return value;
+}
+
+/*
+ * Firmware receive processing for station interface.
+ * ARP agent answers requests for host address and
+ * discards other requests, packet filters discard frames
+ * with other ethertypes. Returns true if frame is passed
+ * to host. Called with scheduler locked.
+ */
+static bool firmwareAccepts(const uint8_t* frame, uint16_t len, wwd_interface_t interface)
+{
+  SimIovar* hostIp;
+  bool      filtered = false;
+  int       i;
+
+  if (interface != WWD_STA_INTERFACE || len < 14)
+    return true;
+
+  hostIp = iovarFind("arp_hostip", interface, false);
+
+  if (frame[12] == 0x08 && frame[13] == 0x06 && len >= SIM_ARP_LEN &&
+      frame[20] == 0 && frame[21] == 1 &&
+      iovarU32(iovarFind("arpoe", interface, false)) != 0 &&
+      (iovarU32(iovarFind("arp_ol", interface, false)) & SIM_ARP_OL_AGENT)) {
+
+    if (hostIp != NULL && hostIp->len == 4 && memcmp(frame + 38, hostIp->data, 4) == 0)
+      ++stats.arpReplies;
+    else
+      ++stats.fwDropped;
+
+    return false;
+  }
+
+  if (!filterForward)
+    return true;
+
+  for (i = 0; i < SIM_FILTERS; i++) {
+
+    if (!filters[i].used || !filters[i].enabled)
+      continue;
+
+    filtered = true;
+    if (filters[i].offset + filters[i].size <= len &&
+        memcmp(frame + filters[i].offset, filters[i].pattern, filters[i].size) == 0)
+      return true;
+  }
+
+  if (!filtered)
+    return true;
+
+  ++stats.fwDropped;
+  return false;
+}
+
+/*
+ * Bus interrupt wakes up bus task like SDIO interrupt
+ * wakes up WWD thread. Semaphore coalesces interrupts,
+ * so wakeups are counted in wdBusWakeups.
+ */
+WWD_RTOS_DEFINE_ISR(busIsr)
+{
+  host_rtos_set_semaphore(&busSema, WICED_TRUE);
+}
+
+WWD_RTOS_MAP_ISR(busIsr, busInterrupt)
+
+/*
+ * Frame received by chip. Unless firmware discards it,
+ * it is queued for bus task and interrupt is raised.
+ */
+static void busReceive(wiced_buffer_t buffer, wwd_interface_t interface)
+{
+  const uint8_t* frame = host_buffer_get_current_piece_data_pointer(buffer);
+  bool           accept;
+
+  posTaskSchedLock();
+  accept = firmwareAccepts(frame, buffer->tot_len, interface);
+  if (accept && busHead - busTail == SIM_BUS_FRAMES) {
+
+    ++stats.busDrops;
+    accept = false;
+  }
+
+  if (accept) {
+
+    busFrames[busHead % SIM_BUS_FRAMES]     = buffer;
+    busInterfaces[busHead % SIM_BUS_FRAMES] = interface;
+    ++busHead;
+    ++stats.interrupts;
+  }
+
+  posTaskSchedUnlock();
+
+  if (!accept) {
+
+    host_buffer_release(buffer, WWD_NETWORK_RX);
+    return;
+  }
+
+  busInterrupt();
+}
+
+/*
+ * Build injected frame in packet buffer.
+ */
+static void injectFrame(void)
+{
+  wiced_buffer_t buffer;
+  uint8_t*       frame;
+
+  if (host_buffer_get(&buffer, WWD_NETWORK_RX, rxLen + SIM_RX_HEADER, WICED_FALSE) != WWD_SUCCESS) {
+
+    ++stats.rxNoBuffer;
+    return;
+  }
+
+  host_buffer_add_remove_at_front(&buffer, SIM_RX_HEADER);
+  frame = host_buffer_get_current_piece_data_pointer(buffer);
+
+  memset(frame, '\0', rxLen);
+  memcpy(frame, rxDst, 6);
+  memcpy(frame + 6, peerMac, 6);
+  frame[12] = rxType >> 8;
+  frame[13] = rxType & 0xff;
+
+  busReceive(buffer, WWD_STA_INTERFACE);
+}
+
+bool wdSimInject(const uint8_t* data, uint16_t len, int interface)
+{
+  wiced_buffer_t buffer;
+
+  P_ASSERT("frame length valid", len >= 14 && len + SIM_RX_HEADER <= WICED_LINK_MTU);
+
+  if (host_buffer_get(&buffer, WWD_NETWORK_RX, len + SIM_RX_HEADER, WICED_FALSE) != WWD_SUCCESS) {
+
+    ++stats.rxNoBuffer;
+    return false;
+  }
+
+  host_buffer_add_remove_at_front(&buffer, SIM_RX_HEADER);
+  memcpy(host_buffer_get_current_piece_data_pointer(buffer), data, len);
+  busReceive(buffer, (wwd_interface_t)interface);
+  return true;
+}
+
+/*
+ * Copy transmitted frame into receive buffer. Frames
+ * sent on station interface are received on AP interface
+ * and vice versa, like there was a cable between two devices.
+ */
+static void loopFrame(wiced_buffer_t tx, wwd_interface_t interface)
+{
+  wiced_buffer_t buffer;
+
+  if (host_buffer_get(&buffer, WWD_NETWORK_RX, tx->tot_len + SIM_RX_HEADER, WICED_FALSE) != WWD_SUCCESS) {
+
+    ++stats.rxNoBuffer;
+    return;
+  }
+
+  host_buffer_add_remove_at_front(&buffer, SIM_RX_HEADER);
+  pbuf_copy_partial(tx, host_buffer_get_current_piece_data_pointer(buffer), tx->tot_len, 0);
+
+  busReceive(buffer, (interface == WWD_STA_INTERFACE) ? WWD_AP_INTERFACE : WWD_STA_INTERFACE);
+}
+
+/*
+ * Pass queued frames to driver like WWD thread would.
+ */
+static void busInput(void)
+{
+  wiced_buffer_t  buffer;
+  wwd_interface_t interface;
+
+  while (true) {
+
+    posTaskSchedLock();
+    if (busHead == busTail) {
+
+      posTaskSchedUnlock();
+      return;
+    }
+
+    buffer    = busFrames[busTail % SIM_BUS_FRAMES];
+    interface = busInterfaces[busTail % SIM_BUS_FRAMES];
+    ++busTail;
+    posTaskSchedUnlock();
+
+    ++stats.rxFrames;
+    stats.rxBytes += buffer->tot_len;
+    host_network_process_ethernet_data(buffer, interface);
+  }
+}
+
+static void simTask(void* arg)
+{
+  JIF_t    last = jiffies;
+  JIF_t    now;
+  uint64_t credit = 0;
+  uint64_t limit;
+  uint32_t rate;
+
+  while (true) {
+
+/*
+ * Wake up on bus interrupt, or on next
+ * tick for injection.
+ */
+    host_rtos_get_semaphore(&busSema, 1, WICED_FALSE);
+    busInput();
+
+/*
+ * Credit is in frames * HZ, cap it to one second
+ * worth of frames so that a stall doesn't cause
+ * a huge burst. 64 bits are needed as rate * HZ
+ * overflows 32 bits with high rates.
+ */
+    now   = jiffies;
+    rate  = rxRate;
+    limit = (uint64_t)rate * HZ;
+    credit += (uint64_t)(JIF_t)(now - last) * rate;
+    last = now;
+
+    if (credit > limit)
+      credit = limit;
+
+    while (credit >= HZ) {
+
+      credit -= HZ;
+      injectFrame();
+    }
+  }
+}
+
+void wdSimStart(int priority)
+{
+  wwd_result_t result;
+
+  result = host_rtos_init_semaphore(&busSema);
+  P_ASSERT("sim semaphore", result == WWD_SUCCESS);
+  wdCoalesceIsrSignals(&busSema);
+
+  nosTaskCreate(simTask, NULL, priority, 0, "wdsim");
+}
+
+void wdSimSetRx(uint32_t rate, uint16_t len, const uint8_t* dst, uint16_t etherType)
+{
+  P_ASSERT("frame length valid", len >= 14 && len + SIM_RX_HEADER <= WICED_LINK_MTU);
+
+  posTaskSchedLock();
+  rxLen  = len;
+  rxType = etherType;
+  if (dst != NULL)
+    memcpy(rxDst, dst, sizeof(rxDst));
+  else
+    memset(rxDst, 0xff, sizeof(rxDst));
+
+  rxRate = rate;
+  posTaskSchedUnlock();
+}
+
+void wdSimSetLoopback(bool on)
+{
+  loopback = on;
+}
+
+void wdSimSetTxHook(WdSimTxHook hook)
+{
+  txHook = hook;
+}
+
+void wdSimStopCycles(bool stop)
+{
+  uint64_t now = wdHostNs();
+
+  posTaskSchedLock();
+  if (stop && wdSimCyclesStopped == 0)
+    wdSimCyclesStopped = now;
+  else if (!stop && wdSimCyclesStopped != 0) {
+
+    wdSimCyclesLost += now - wdSimCyclesStopped;
+    wdSimCyclesStopped = 0;
+  }
+
+  posTaskSchedUnlock();
+}
+
+void wdSimSetReady(bool ready)
+{
+  simReady = ready;
+}
+
+void wdGetSimStats(WdSimStats* st)
+{
+  *st = stats;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#ifndef _WD_CYCLES_H
+#define _WD_CYCLES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+
+/*
+ * Host port has no cycle counter, use monotonic
+ * clock in nanoseconds instead. Wraps around at 32 bits.
+ * Simulator can stop the counter like MCU sleep would
+ * (wdSimStopCycles() in wd_sim.h).
+ */
+#define WD_CYCLES_PER_SEC 1000000000UL
+
+/*
+ * Frequency is a compile-time constant.
+ */
+#define WD_CYCLES_RATE_CONSTANT 1
+
+static inline void wdCyclesInit(void)
+{
+}
+
+extern volatile uint64_t wdSimCyclesStopped;
+extern volatile uint64_t wdSimCyclesLost;
+
+static inline uint64_t wdHostNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint32_t wdCycles(void)
+{
+  uint64_t ns = wdSimCyclesStopped;
+
+  if (ns == 0)
+    ns = wdHostNs();
+
+  return (uint32_t)(ns - wdSimCyclesLost);
+}
+
+/*
+ * Nanoseconds since timer tick counted by jiffies. Pico]OS
+ * unix port ticks with ITIMER_REAL, so time left on it tells
+ * where in the tick we are. Pending SIGALRM means that tick
+ * has expired but jiffies don't include it yet. Timer is read
+ * again in that case, in case it expired during first read.
+ * Returns false if timer is not running.
+ */
+#define WD_CYCLES_SINCE_TICK 1
+
+static inline uint64_t wdTimevalNs(const struct timeval* tv)
+{
+  return (uint64_t)tv->tv_sec * 1000000000ULL + (uint64_t)tv->tv_usec * 1000;
+}
+
+static inline bool wdCyclesSinceTick(uint32_t* cycles)
+{
+  struct itimerval it;
+  sigset_t         pending;
+  uint64_t         period;
+  uint64_t         left;
+  bool             late;
+
+  if (getitimer(ITIMER_REAL, &it) == -1 || !timerisset(&it.it_interval))
+    return false;
+
+  sigpending(&pending);
+  late = sigismember(&pending, SIGALRM);
+  if (late)
+    getitimer(ITIMER_REAL, &it);
+
+  period = wdTimevalNs(&it.it_interval);
+  left   = wdTimevalNs(&it.it_value);
+  if (left > period)
+    left = period;
+
+  *cycles = (uint32_t)(period - left + (late ? period : 0));
+  return true;
+}
+
+#endif /* _WD_CYCLES_H */
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#ifndef _WD_SIM_H
+#define _WD_SIM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Simulated WWD bus for host port. It accepts transmitted
+ * frames and injects received frames at configured rate,
+ * so that glue layer can be exercised without hardware.
+ * Received frames go through firmware ARP offload and packet
+ * filters written by driver, and frames passed to host raise
+ * bus interrupt that wakes up simulator task like WWD thread.
+ */
+typedef struct {
+
+  uint32_t txFrames;    //!< Frames sent by driver.
+  uint32_t txBytes;
+  uint32_t rxFrames;    //!< Frames passed to driver.
+  uint32_t rxBytes;
+  uint32_t rxNoBuffer;  //!< Injections skipped because no buffer was available.
+  uint32_t busDrops;    //!< Received frames dropped because sim task queue was full.
+  uint32_t fwDropped;   //!< Frames discarded by firmware packet filter or ARP agent.
+  uint32_t arpReplies;  //!< ARP requests answered by firmware.
+  uint32_t interrupts;  //!< Bus interrupts raised for received frames.
+  uint32_t iovars;      //!< Iovar requests sent to simulated firmware.
+  uint32_t inits;       //!< Calls to wwd_management_init().
+} WdSimStats;
+
+/**
+ * Called for each transmitted frame.
+ */
+typedef void (*WdSimTxHook)(const uint8_t* frame, uint16_t len);
+
+/**
+ * Start simulated bus task at given priority.
+ */
+void wdSimStart(int priority);
+
+/**
+ * Set receive injection. Rate is in frames per second (0 stops
+ * injection). Destination is MAC address for injected frames,
+ * NULL means broadcast.
+ */
+void wdSimSetRx(uint32_t rate, uint16_t len, const uint8_t* dst, uint16_t etherType);
+
+/**
+ * Inject one received frame now. Returns false
+ * if no buffer was available.
+ */
+bool wdSimInject(const uint8_t* frame, uint16_t len, int interface);
+
+/**
+ * Loop transmitted frames back to driver as received ones.
+ * Frames sent on station interface are received on AP
+ * interface and vice versa. Receive runs in sim task,
+ * not in transmitting task.
+ */
+void wdSimSetLoopback(bool on);
+
+/**
+ * Set hook that is called for transmitted frames.
+ */
+void wdSimSetTxHook(WdSimTxHook hook);
+
+/**
+ * Simulate link that is (not) ready to transmit.
+ */
+void wdSimSetReady(bool ready);
+
+/**
+ * Get last value written to firmware iovar of interface.
+ * Returns length of value, -1 if iovar has not been set
+ * since firmware was last initialized.
+ */
+int wdSimGetIovar(const char* name, int interface, void* buf, int size);
+
+/**
+ * Make next count iovar set requests fail
+ * with WWD_TIMEOUT.
+ */
+void wdSimFailIovars(int count);
+
+/**
+ * Stop (or restart) cycle counter, like cycle counter
+ * of MCU stops in deep sleep.
+ */
+void wdSimStopCycles(bool stop);
+
+/**
+ * Get ethertypes passed by enabled firmware packet filters.
+ * Returns 0 if filtering is not active.
+ */
+int wdSimGetPacketFilters(uint16_t* types, int max);
+
+/**
+ * Get simulated bus counters.
+ */
+void wdGetSimStats(WdSimStats* stats);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif /* __cplusplus */
+
+#endif /* _WD_SIM_H */
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#ifndef _WWD_RTOS_ISR_H
+#define _WWD_RTOS_ISR_H
+
+#include "wwd_rtos.h"
+#include "wd_trace.h"
+
+/*
+ * Interrupt entry time for WWD wakeup latency histogram.
+ */
+#if defined(WDCFG_LATENCY_HIST) && WDCFG_LATENCY_HIST
+
+#include "wd_cycles.h"
+
+extern volatile uint32_t wdIsrEntryCycles;
+
+#define WD_ISR_ENTER() wdIsrEntryCycles = wdCycles()
+
+#else
+
+#define WD_ISR_ENTER() do {} while (0)
+
+#endif
+
+/*
+ * Declare interrupt handler "body" function.
+ */
+#define WWD_RTOS_DEFINE_ISR(function) void function(void); \
+                                      void function(void)
+/*
+ * Host port has no bus interrupts, simulated bus (sim_bus.c)
+ * delivers frames from a task. Map just calls the body
+ * with Pico]OS interrupt enter/exit.
+ */
+#define WWD_RTOS_MAP_ISR(function, isr) void isr(void) { \
+                                            WD_ISR_ENTER(); \
+                                            c_pos_intEnter(); \
+                                            WD_TRACE(WD_TRACE_ISR, 0); \
+                                            function(); \
+                                            c_pos_intExit(); \
+                                          }
+
+#endif /* _WWD_RTOS_ISR_H */
@@ -25,6 +25,7 @@
  * OF SUCH DAMAGE.
  */
 
+#include <picoos.h>
 #include "wifi_nvram_image.h"
 #include "platform/wwd_resource_interface.h"
 #include "wiced_resource.h"
@@ -34,6 +35,9 @@
 #include "wiced_waf_common.h"
 #include "lwip/opt.h"
 
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -60,35 +64,451 @@ void*    dynamic_nvram_image = &wifi_nvram_image;
 #define WDCFG_FIRMWARE_PATH "/firmware"
 #endif
 
+/*
+ * Size of read-ahead buffer for firmware file.
+ * Reads smaller than this are served from buffer.
+ */
+#ifndef WDCFG_FIRMWARE_READAHEAD
+#define WDCFG_FIRMWARE_READAHEAD 512
+#endif
+
+/*
+ * Support for compressed firmware container (see tools/wdzpack.py).
+ * File starts with "WDZ1" magic, uncompressed size and block size
+ * (32-bit little endian). Each block has 32-bit length header followed
+ * by LZ4 block data (or raw data if bit 31 of length is set). Blocks
+ * decompress independently to block size bytes (last block may
+ * be shorter). Two block-sized buffers are allocated during download.
+ */
+#ifndef WDCFG_FIRMWARE_COMPRESSION
+#define WDCFG_FIRMWARE_COMPRESSION 1
+#endif
+
+#ifndef WDCFG_FIRMWARE_MAX_BLOCK
+#define WDCFG_FIRMWARE_MAX_BLOCK 4096
+#endif
+
+#define WDZ_MAGIC       "WDZ1"
+#define WDZ_HEADER_SIZE 12
+#define WDZ_RAW_BLOCK   0x80000000
+
 const char* firmwarePath[] = { WDCFG_FIRMWARE_PATH };
 
-wwd_result_t host_platform_resource_size(wwd_resource_t resource, uint32_t* size_out)
+/*
+ * Firmware file is kept open during download
+ * and closed after last byte has been read.
+ */
+typedef struct {
+
+  int      fd;
+  uint32_t size;
+  uint32_t pos;
+#if WDCFG_FIRMWARE_READAHEAD > 0
+  uint32_t bufOffset;
+  uint32_t bufLen;
+  uint8_t  buf[WDCFG_FIRMWARE_READAHEAD];
+#endif
+#if WDCFG_FIRMWARE_COMPRESSION
+  bool     compressed;
+  uint32_t blockSize;
+  uint32_t nextBlock;
+  uint32_t nextBlockPos;
+  uint32_t curBlock;
+  uint32_t curLen;
+  uint8_t* in;
+  uint8_t* out;
+#endif
+} FirmwareFile;
+
+static FirmwareFile fw = { .fd = -1 };
+
+/*
+ * Resource images registered by application
+ * (for example in memory-mapped flash).
+ */
+typedef struct {
+
+  const uint8_t* data;
+  uint32_t       size;
+} ResourceImage;
+
+static ResourceImage fwImage;
+static ResourceImage nvramImage;
+
+void wdSetFirmwareImage(const void* image, uint32_t size)
 {
-  if (resource == WWD_RESOURCE_WLAN_FIRMWARE) {
+  fwImage.data = image;
+  fwImage.size = size;
+}
+
+void wdSetNvramImage(const void* image, uint32_t size)
+{
+  nvramImage.data = image;
+  nvramImage.size = size;
+}
+
+static void firmwareClose(void)
+{
+  if (fw.fd != -1) {
+
+    close(fw.fd);
+    fw.fd = -1;
+  }
+
+#if WDCFG_FIRMWARE_READAHEAD > 0
+  fw.bufLen = 0;
+#endif
+
+#if WDCFG_FIRMWARE_COMPRESSION
+  if (fw.in != NULL)
+    nosMemFree(fw.in);
+
+  if (fw.out != NULL)
+    nosMemFree(fw.out);
+
+  fw.in  = NULL;
+  fw.out = NULL;
+  fw.compressed = false;
+#endif
+}
+
+void wdFirmwareRelease(void)
+{
+  firmwareClose();
+}
+
+/*
+ * Read from firmware file, seeking only if
+ * read is not sequential.
+ */
+static int firmwareRead(uint32_t offset, void* buffer, uint32_t len)
+{
+  int n;
+
+  if (fw.pos != offset) {
+
+    if (lseek(fw.fd, offset, SEEK_SET) == -1)
+      return -1;
+
+    fw.pos = offset;
+  }
+
+  n = read(fw.fd, buffer, len);
+  if (n > 0)
+    fw.pos += n;
+
+  return n;
+}
+
+#if WDCFG_FIRMWARE_COMPRESSION
+
+static uint32_t getLE32(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
-    struct stat st;
-    unsigned int i;
 /*
- * Get size of firmware from filesystem.
+ * Decode LZ4 block. Returns decoded length
+ * or -1 if data is invalid.
  */
-    for (i = 0; i < sizeof(firmwarePath) / sizeof(firmwarePath[0]); i++) {
+static int lz4Decode(const uint8_t* src, uint32_t srcLen, uint8_t* dst, uint32_t dstMax)
+{
+  const uint8_t* ip   = src;
+  const uint8_t* iend = src + srcLen;
+  uint8_t*       op   = dst;
+  uint8_t*       oend = dst + dstMax;
+  const uint8_t* match;
+  uint32_t       len;
+  uint32_t       off;
+  unsigned int   token;
+  uint8_t        b;
+
+  while (ip < iend) {
+
+    token = *ip++;
+
+    // literals
+    len = token >> 4;
+    if (len == 15) {
 
-      char buf[80];
-      sprintf(buf, "%s/%s", firmwarePath[i], WDCFG_FIRMWARE);
-      if (stat(buf, &st) != -1) {
+      do {
 
-        *size_out = st.st_size;
-        return WWD_SUCCESS;
+        if (ip >= iend)
+          return -1;
+
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+
+    if (len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op))
+      return -1;
+
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+
+    // last sequence has only literals
+    if (ip == iend)
+      break;
+
+    // match
+    if (iend - ip < 2)
+      return -1;
+
+    off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (off == 0 || off > (uint32_t)(op - dst))
+      return -1;
+
+    len = token & 15;
+    if (len == 15) {
+
+      do {
+
+        if (ip >= iend)
+          return -1;
+
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+
+    len += 4;
+    if (len > (uint32_t)(oend - op))
+      return -1;
+
+    // byte by byte, as match may overlap output
+    match = op - off;
+    while (len--)
+      *op++ = *match++;
+  }
+
+  return op - dst;
+}
+
+static bool firmwareReadFully(uint32_t offset, uint8_t* buffer, uint32_t len)
+{
+  int n;
+
+  while (len > 0) {
+
+    n = firmwareRead(offset, buffer, len);
+    if (n <= 0)
+      return false;
+
+    offset += n;
+    buffer += n;
+    len    -= n;
+  }
+
+  return true;
+}
+
+/*
+ * Check if firmware file is compressed container
+ * and prepare for decompression if so.
+ */
+static bool firmwareCheckCompressed(void)
+{
+  uint8_t hdr[WDZ_HEADER_SIZE];
+
+  if (fw.size < WDZ_HEADER_SIZE ||
+      !firmwareReadFully(0, hdr, sizeof(hdr)) ||
+      memcmp(hdr, WDZ_MAGIC, 4) != 0)
+    return true;
+
+  fw.size      = getLE32(hdr + 4);
+  fw.blockSize = getLE32(hdr + 8);
+  if (fw.blockSize == 0 || fw.blockSize > WDCFG_FIRMWARE_MAX_BLOCK)
+    return false;
+
+  fw.in  = nosMemAlloc(fw.blockSize);
+  fw.out = nosMemAlloc(fw.blockSize);
+  if (fw.in == NULL || fw.out == NULL)
+    return false;
+
+  fw.compressed   = true;
+  fw.nextBlock    = 0;
+  fw.nextBlockPos = WDZ_HEADER_SIZE;
+  fw.curBlock     = UINT32_MAX;
+  fw.curLen       = 0;
+  return true;
+}
+
+/*
+ * Decompress given block into output buffer. Blocks before
+ * it are skipped by seeking over them.
+ */
+static bool firmwareDecodeBlock(uint32_t block)
+{
+  uint8_t  hdr[4];
+  uint32_t len;
+  bool     raw;
+  int      n;
+
+  if (block < fw.nextBlock) {
+
+    fw.nextBlock    = 0;
+    fw.nextBlockPos = WDZ_HEADER_SIZE;
+  }
+
+  while (fw.nextBlock <= block) {
+
+    if (!firmwareReadFully(fw.nextBlockPos, hdr, sizeof(hdr)))
+      return false;
+
+    len = getLE32(hdr);
+    raw = (len & WDZ_RAW_BLOCK) != 0;
+    len &= ~WDZ_RAW_BLOCK;
+    if (len > fw.blockSize)
+      return false;
+
+    if (fw.nextBlock == block) {
+
+      if (!firmwareReadFully(fw.nextBlockPos + sizeof(hdr), raw ? fw.out : fw.in, len))
+        return false;
+
+      if (raw)
+        fw.curLen = len;
+      else {
+
+        n = lz4Decode(fw.in, len, fw.out, fw.blockSize);
+        if (n < 0)
+          return false;
+
+        fw.curLen = n;
       }
+
+      fw.curBlock = block;
     }
 
-    return RESOURCE_UNSUPPORTED;
+    fw.nextBlockPos += sizeof(hdr) + len;
+    ++fw.nextBlock;
+  }
+
+  return true;
+}
+
+/*
+ * Read uncompressed data from compressed container.
+ */
+static int firmwareReadCompressed(uint32_t offset, uint8_t* buffer, uint32_t len)
+{
+  uint32_t block = offset / fw.blockSize;
+  uint32_t skip  = offset % fw.blockSize;
+
+  if (block != fw.curBlock && !firmwareDecodeBlock(block))
+    return -1;
+
+  if (skip >= fw.curLen)
+    return -1;
+
+  len = MIN(len, fw.curLen - skip);
+  memcpy(buffer, fw.out + skip, len);
+  return len;
+}
+
+#endif
+
+static bool firmwareOpen(void)
+{
+  struct stat st;
+  unsigned int i;
+
+  if (fw.fd != -1)
+    return true;
+
+  for (i = 0; i < sizeof(firmwarePath) / sizeof(firmwarePath[0]); i++) {
+
+    char buf[80];
+    snprintf(buf, sizeof(buf), "%s/%s", firmwarePath[i], WDCFG_FIRMWARE);
+    fw.fd = open(buf, O_RDONLY);
+    if (fw.fd != -1) {
+
+      if (fstat(fw.fd, &st) == -1) {
+
+        firmwareClose();
+        return false;
+      }
+
+      fw.size = st.st_size;
+      fw.pos  = 0;
+
+#if WDCFG_FIRMWARE_COMPRESSION
+      if (!firmwareCheckCompressed()) {
+
+        firmwareClose();
+        return false;
+      }
+#endif
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+wwd_result_t host_platform_resource_size(wwd_resource_t resource, uint32_t* size_out)
+{
+  if (resource == WWD_RESOURCE_WLAN_FIRMWARE) {
+
+    if (fwImage.data != NULL) {
+
+      *size_out = fwImage.size;
+      return WWD_SUCCESS;
+    }
+
+/*
+ * Get size of firmware from filesystem. WWD asks for
+ * size when download starts, so a file left open by
+ * aborted download is closed here.
+ */
+    firmwareClose();
+    if (!firmwareOpen())
+      return RESOURCE_UNSUPPORTED;
+
+    *size_out = fw.size;
+    return WWD_SUCCESS;
   }
   else
   {
-      *size_out = NVRAM_SIZE;
+      *size_out = (nvramImage.data != NULL) ? nvramImage.size : NVRAM_SIZE;
+  }
+
+  return WWD_SUCCESS;
+}
+
+/*
+ * Used by WWD when compiled with WWD_DIRECT_RESOURCES.
+ * Works only if image is registered, or for built-in nvram.
+ */
+wwd_result_t host_platform_resource_read_direct(wwd_resource_t resource, const void** ptr_out)
+{
+  if (resource == WWD_RESOURCE_WLAN_FIRMWARE) {
+
+    if (fwImage.data == NULL)
+      return RESOURCE_UNSUPPORTED;
+
+    *ptr_out = fwImage.data;
   }
+  else {
+
+    *ptr_out = (nvramImage.data != NULL) ? (const void*)nvramImage.data : (const void*)NVRAM_IMAGE_VARIABLE;
+  }
+
+  return WWD_SUCCESS;
+}
 
+static wwd_result_t imageRead(const ResourceImage* image,
+                              uint32_t offset,
+                              void* buffer,
+                              uint32_t buffer_size,
+                              uint32_t* size_out)
+{
+  *size_out = (offset < image->size) ? MIN(buffer_size, image->size - offset) : 0;
+  memcpy(buffer, image->data + offset, *size_out);
   return WWD_SUCCESS;
 }
 
@@ -100,43 +520,92 @@ wwd_result_t host_platform_resource_read_indirect(wwd_resource_t resource,
 {
   if (resource == WWD_RESOURCE_WLAN_FIRMWARE) {
 
-    int fd;
-    unsigned int i;
+    uint8_t* ptr = buffer;
+    uint32_t done = 0;
+    int      len;
 
-    for (i = 0; i < sizeof(firmwarePath) / sizeof(firmwarePath[0]); i++) {
+    if (fwImage.data != NULL)
+      return imageRead(&fwImage, offset, buffer, buffer_size, size_out);
 
-      char buf[80];
-      sprintf(buf, "%s/%s", firmwarePath[i], WDCFG_FIRMWARE);
-      fd = open(buf, O_RDONLY);
-      if (fd != -1) {
+    if (!firmwareOpen())
+      return RESOURCE_UNSUPPORTED;
 
-        if (lseek(fd, offset, SEEK_SET) == -1) {
+    if (offset >= fw.size) {
 
-           *size_out = 0;
-        }
-        else {
+      *size_out = 0;
+      firmwareClose();
+      return WWD_SUCCESS;
+    }
+
+    buffer_size = MIN(buffer_size, fw.size - offset);
+    while (done < buffer_size) {
+
+#if WDCFG_FIRMWARE_COMPRESSION
+
+      if (fw.compressed) {
+
+        len = firmwareReadCompressed(offset + done, ptr + done, buffer_size - done);
+        if (len <= 0)
+          break;
+
+        done += len;
+        continue;
+      }
+
+#endif
+
+#if WDCFG_FIRMWARE_READAHEAD > 0
 
-           int len;
+      uint32_t cur = offset + done;
 
-           len = read(fd, buffer, buffer_size);
-           if (len == -1) {
+      if (fw.bufLen > 0 && cur >= fw.bufOffset && cur < fw.bufOffset + fw.bufLen) {
 
-             close(fd);
-             return RESOURCE_UNSUPPORTED;
-           }
+        len = MIN(buffer_size - done, fw.bufOffset + fw.bufLen - cur);
+        memcpy(ptr + done, fw.buf + (cur - fw.bufOffset), len);
+        done += len;
+        continue;
+      }
+
+      if (buffer_size - done < WDCFG_FIRMWARE_READAHEAD) {
+
+        len = firmwareRead(cur, fw.buf, WDCFG_FIRMWARE_READAHEAD);
+        if (len <= 0) {
 
-           *size_out = len;
+          fw.bufLen = 0;
+          break;
         }
 
-        close(fd);
-        return WWD_SUCCESS;
+        fw.bufOffset = cur;
+        fw.bufLen    = len;
+        continue;
       }
+
+#endif
+
+      len = firmwareRead(offset + done, ptr + done, buffer_size - done);
+      if (len <= 0)
+        break;
+
+      done += len;
+    }
+
+    if (done == 0 && buffer_size > 0) {
+
+      firmwareClose();
+      return RESOURCE_UNSUPPORTED;
     }
 
-    return RESOURCE_UNSUPPORTED;
+    *size_out = done;
+    if (offset + done >= fw.size)
+      firmwareClose();
+
+    return WWD_SUCCESS;
   }
   else {
 
+     if (nvramImage.data != NULL)
+       return imageRead(&nvramImage, offset, buffer, buffer_size, size_out);
+
      *size_out = MIN(buffer_size, NVRAM_SIZE - offset);
      memcpy(buffer, &NVRAM_IMAGE_VARIABLE[ offset ], *size_out);
      return WWD_SUCCESS;
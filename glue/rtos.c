@@ -27,12 +27,189 @@
 
 #include "wwd_rtos.h"
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include "wwd_constants.h"
 #include "wwd_assert.h"
 #include "RTOS/wwd_rtos_interface.h"
 #include "wiced_utilities.h"
+#include "wd_glue.h"
+#include "wwd_rtos_isr.h"
 
-#define TMO2TICKS(t) (t == NEVER_TIMEOUT ? INFINITE : MS(t))
+#define TMO2TICKS(t) ((t) == NEVER_TIMEOUT ? INFINITE : wdMsToTicks(t))
+
+/*
+ * Maximum time to wait (ms) in host_rtos_join_thread.
+ */
+#ifndef WDCFG_THREAD_JOIN_TIMEOUT
+#define WDCFG_THREAD_JOIN_TIMEOUT NEVER_TIMEOUT
+#endif
+
+/*
+ * Maximum time to wait (ms) for mutex. Lock
+ * fails with WWD_TIMEOUT after that.
+ */
+#ifndef WDCFG_MUTEX_TIMEOUT
+#define WDCFG_MUTEX_TIMEOUT NEVER_TIMEOUT
+#endif
+
+/*
+ * Number of threads and queues tracked
+ * for diagnostics.
+ */
+#ifndef WDCFG_MAX_THREADS
+#define WDCFG_MAX_THREADS 4
+#endif
+
+#ifndef WDCFG_MAX_QUEUES
+#define WDCFG_MAX_QUEUES 4
+#endif
+
+#define STACK_PAINT 0xA5
+
+static host_thread_type_t* threads[WDCFG_MAX_THREADS];
+static host_queue_type_t*  queues[WDCFG_MAX_QUEUES];
+static WdRtosStats         rtosStats;
+
+/*
+ * Counters are updated with scheduler locked, so that
+ * concurrent updates and peak tracking don't race.
+ */
+#define STAT_ADD(cur, peak, n) do { posTaskSchedLock();                  \
+                                    rtosStats.cur += (n);                \
+                                    if (rtosStats.cur > rtosStats.peak)  \
+                                      rtosStats.peak = rtosStats.cur;    \
+                                    posTaskSchedUnlock();                \
+                                  } while (0)
+
+#define STAT_SUB(cur, n)       do { posTaskSchedLock();                  \
+                                    rtosStats.cur -= (n);                \
+                                    posTaskSchedUnlock();                \
+                                  } while (0)
+
+/*
+ * Remember object in diagnostics table.
+ */
+static void track(void** table, int size, void* obj)
+{
+  int i;
+
+  posTaskSchedLock();
+  for (i = 0; i < size; i++)
+    if (table[i] == NULL) {
+
+      table[i] = obj;
+      break;
+    }
+
+  posTaskSchedUnlock();
+}
+
+static void untrack(void** table, int size, void* obj)
+{
+  int i;
+
+  posTaskSchedLock();
+  for (i = 0; i < size; i++)
+    if (table[i] == obj)
+      table[i] = NULL;
+
+  posTaskSchedUnlock();
+}
+
+/*
+ * Semaphore creation and destruction with accounting.
+ */
+static POSSEMA_t semaCreate(INT_t count, const char* name)
+{
+  POSSEMA_t sema = nosSemaCreate(count, 0, name);
+
+  if (sema != NULL)
+    STAT_ADD(semaphores, peakSemaphores, 1);
+
+  return sema;
+}
+
+static void semaDestroy(POSSEMA_t sema)
+{
+  nosSemaDestroy(sema);
+  STAT_SUB(semaphores, 1);
+}
+
+#if POSCFG_TASKSTACKTYPE == 0
+
+/*
+ * Stacks of deleted threads whose tasks were not yet
+ * confirmed to be gone. Stack is freed only after Pico]OS
+ * reports task as unused, they are checked again when
+ * threads are created or deleted and when stats are read.
+ */
+typedef struct {
+
+  POSTASK_t task;
+  uint8_t*  stack;
+  uint32_t  size;
+} DeadStack;
+
+static DeadStack deadStacks[WDCFG_MAX_THREADS];
+
+static void stackFree(uint8_t* stack, uint32_t size)
+{
+  nosMemFree(stack);
+  STAT_SUB(stackBytes, size);
+}
+
+static void stackReap(void)
+{
+#if POSCFG_FEATURE_TASKUNUSED != 0
+  int i;
+
+  for (i = 0; i < WDCFG_MAX_THREADS; i++) {
+
+    if (deadStacks[i].stack != NULL && posTaskUnused(deadStacks[i].task)) {
+
+      stackFree(deadStacks[i].stack, deadStacks[i].size);
+      deadStacks[i].stack = NULL;
+    }
+  }
+#endif
+}
+
+/*
+ * Release stack of thread. If task cannot be confirmed
+ * to be gone, stack is parked for later. Without
+ * POSCFG_FEATURE_TASKUNUSED (or if there is no room to park
+ * it) the stack is leaked, which is still better than freeing
+ * a stack that is in use. Leaked stack remains in stackBytes.
+ */
+static void stackRelease(host_thread_type_t* thread)
+{
+#if POSCFG_FEATURE_TASKUNUSED != 0
+  int i;
+
+  if (thread->task == NULL || posTaskUnused(thread->task)) {
+
+    stackFree(thread->stack, thread->stackSize);
+    return;
+  }
+
+  for (i = 0; i < WDCFG_MAX_THREADS; i++) {
+
+    if (deadStacks[i].stack == NULL) {
+
+      deadStacks[i].task  = thread->task;
+      deadStacks[i].stack = thread->stack;
+      deadStacks[i].size  = thread->stackSize;
+      return;
+    }
+  }
+#else
+  if (thread->task == NULL)
+    stackFree(thread->stack, thread->stackSize);
+#endif
+}
+
+#endif
 
 /*
  * Create thrad.
@@ -53,6 +230,27 @@ wwd_result_t host_rtos_create_thread(host_thread_type_t* thread,
                                           0);
 }
 
+/*
+ * Signal joiner and terminate current thread.
+ */
+static void threadExit(host_thread_type_t* thread)
+{
+  nosSemaSignal(thread->done);
+  nosTaskExit();
+}
+
+/*
+ * Thread entry, calls actual thread function and
+ * handles exit if it returns.
+ */
+static void threadStart(void* arg)
+{
+  host_thread_type_t* thread = (host_thread_type_t*)arg;
+
+  thread->entry(thread->arg);
+  threadExit(thread);
+}
+
 /*
  * Create thread with arg.
  */
@@ -64,12 +262,72 @@ wwd_result_t host_rtos_create_thread_with_arg(host_thread_type_t* thread,
                                               uint32_t priority,
                                               uint32_t arg)
 {
-  P_ASSERT("Cannot use pre-allocated thread stack.", stack == NULL);
+#if POSCFG_TASKSTACKTYPE != 0
+  P_ASSERT("Pre-allocated thread stack needs POSCFG_TASKSTACKTYPE 0.", stack == NULL);
+#endif
 
-  *thread = nosTaskCreate((POSTASKFUNC_t)entryFunction, (void*)arg, priority, stackSize, name);
-  if (*thread == NULL)
+#if POSCFG_TASKSTACKTYPE == 0
+  stackReap();
+#endif
+
+  thread->task           = NULL;
+  thread->entry          = entryFunction;
+  thread->arg            = arg;
+  thread->name           = name;
+  thread->stack          = NULL;
+  thread->stackSize      = stackSize;
+  thread->stackAllocated = 0;
+  thread->done           = semaCreate(0, "wwdjoin");
+  if (thread->done == NULL)
     return WWD_THREAD_CREATE_FAILED;
 
+#if POSCFG_TASKSTACKTYPE == 0
+
+/*
+ * Allocate stack here if caller didn't give one, so that
+ * it can be painted for high-water mark measurement.
+ */
+  if (stack == NULL) {
+
+    stack = nosMemAlloc(stackSize);
+    if (stack == NULL) {
+
+      host_rtos_delete_terminated_thread(thread);
+      return WWD_THREAD_CREATE_FAILED;
+    }
+
+    thread->stackAllocated = 1;
+    STAT_ADD(stackBytes, peakStackBytes, stackSize);
+  }
+
+  thread->stack = stack;
+  memset(stack, STACK_PAINT, stackSize);
+
+/*
+ * Stack grows down, so Pico]OS wants the end of stack area.
+ * Keep it 8-byte aligned as required by ABI.
+ */
+  uintptr_t top = ((uintptr_t)stack + stackSize) & ~(uintptr_t)7;
+
+  thread->task = posTaskCreate(threadStart, thread, priority, (void*)top);
+  if (thread->task != NULL)
+    POS_SETTASKNAME(thread->task, name);
+
+#else
+
+  thread->task = nosTaskCreate(threadStart, thread, priority, stackSize, name);
+  if (thread->task != NULL)
+    STAT_ADD(stackBytes, peakStackBytes, stackSize);
+
+#endif
+
+  if (thread->task == NULL) {
+
+    host_rtos_delete_terminated_thread(thread);
+    return WWD_THREAD_CREATE_FAILED;
+  }
+
+  track((void**)threads, WDCFG_MAX_THREADS, thread);
   return WWD_SUCCESS;
 }
 
@@ -78,32 +336,70 @@ wwd_result_t host_rtos_create_thread_with_arg(host_thread_type_t* thread,
  */
 wwd_result_t host_rtos_finish_thread(host_thread_type_t* thread)
 {
-  P_ASSERT("Cannot delete thread other than current one.", *thread == nosTaskGetCurrent());
-  nosTaskExit();
+  P_ASSERT("Cannot delete thread other than current one.", thread->task == nosTaskGetCurrent());
+  threadExit(thread);
   return WWD_SUCCESS;
 }
 
 
 /*
  * Wait for another thead to terminate.
- * Not very sophisticated implementation, just loops and waits.
  */
 wwd_result_t host_rtos_join_thread(host_thread_type_t* thread)
 {
-  while (!nosTaskUnused(*thread)) {
+  if (thread->done == NULL)
+    return WWD_SUCCESS;
 
-    nosTaskSleep(MS(10));
-  }
+  if (nosSemaWait(thread->done, TMO2TICKS(WDCFG_THREAD_JOIN_TIMEOUT)))
+    return WWD_TIMEOUT;
 
+/*
+ * Allow multiple joins.
+ */
+  nosSemaSignal(thread->done);
   return WWD_SUCCESS;
 }
 
 /*
  * Delete terminated thread.
- * Not needed for Pico]OS.
+ * Pico]OS frees the task itself, just get rid
+ * of completion semaphore and stack.
  */
 wwd_result_t host_rtos_delete_terminated_thread(host_thread_type_t* thread)
 {
+  untrack((void**)threads, WDCFG_MAX_THREADS, thread);
+  if (thread->done != NULL) {
+
+    semaDestroy(thread->done);
+    thread->done = NULL;
+  }
+
+#if POSCFG_TASKSTACKTYPE == 0
+
+/*
+ * Thread signals joiner just before exiting, so it
+ * might still be running on its stack.
+ */
+  if (thread->stackAllocated) {
+
+    stackRelease(thread);
+    thread->stackAllocated = 0;
+  }
+
+  stackReap();
+
+#else
+
+/*
+ * Pico]OS frees the stack when task has exited.
+ */
+  if (thread->task != NULL)
+    STAT_SUB(stackBytes, thread->stackSize);
+
+#endif
+
+  thread->stack = NULL;
+  thread->task  = NULL;
   return WWD_SUCCESS;
 }
 
@@ -113,13 +409,25 @@ wwd_result_t host_rtos_delete_terminated_thread(host_thread_type_t* thread)
  */
 wwd_result_t host_rtos_init_semaphore(host_semaphore_type_t* semaphore)
 {
-  *semaphore = nosSemaCreate(0, 0, "wwd*");
-  if (*semaphore == NULL)
+  semaphore->coalesce   = 0;
+  semaphore->isrPending = 0;
+  semaphore->sema = semaCreate(0, "wwd*");
+  if (semaphore->sema == NULL)
     return WWD_SEMAPHORE_ERROR;
 
   return WWD_SUCCESS;
 }
 
+/*
+ * Coalesce interrupt signals of semaphore. Used only for
+ * WWD thread wakeup semaphore, where a single wakeup handles
+ * all pending bus events (see wiced.patch).
+ */
+void wdCoalesceIsrSignals(host_semaphore_type_t* semaphore)
+{
+  semaphore->coalesce = 1;
+}
+
 
 /*
  * Get (wait for) semaphore.
@@ -128,20 +436,52 @@ wwd_result_t host_rtos_get_semaphore(host_semaphore_type_t* semaphore,
                                      uint32_t timeoutMS,
                                      wiced_bool_t isISR)
 {
-  if (nosSemaWait(*semaphore, TMO2TICKS(timeoutMS)))
+  WD_TRACE(WD_TRACE_SEMA_WAIT, semaphore);
+  if (nosSemaWait(semaphore->sema, TMO2TICKS(timeoutMS))) {
+
+    WD_TRACE(WD_TRACE_SEMA_TIMEOUT, semaphore);
     return WWD_TIMEOUT;
+  }
+
+  WD_TRACE(WD_TRACE_SEMA_WAKE, semaphore);
+
+/*
+ * Clear interrupt event before caller starts processing,
+ * so that next interrupt wakes it up again.
+ */
+  if (semaphore->coalesce && semaphore->isrPending) {
+
+    WD_HIST_END(WD_HIST_ISR_WAKEUP, semaphore->isrCycles);
+    semaphore->isrPending = 0;
+  }
 
   return WWD_SUCCESS;
 }
 
 
 /*
- * Set a semaphore.
+ * Set a semaphore. When called from interrupt for a coalescing
+ * semaphore, it is signalled only once until waiting thread
+ * has woken up. Other semaphores count every signal.
  */
 wwd_result_t host_rtos_set_semaphore(host_semaphore_type_t* semaphore, wiced_bool_t fromISR)
 {
   P_ASSERT("fromISR / posInInterrupt_g mismatch.", (fromISR == 0) == (posInInterrupt_g == 0));
-  nosSemaSignal(*semaphore);
+  if (fromISR && semaphore->coalesce) {
+
+    if (semaphore->isrPending)
+      return WWD_SUCCESS;
+
+    ++wdBusWakeups;
+
+#if WDCFG_LATENCY_HIST
+    semaphore->isrCycles = wdIsrEntryCycles;
+#endif
+    semaphore->isrPending = 1;
+  }
+
+  WD_TRACE(WD_TRACE_SEMA_SIGNAL, semaphore);
+  nosSemaSignal(semaphore->sema);
   return WWD_SUCCESS;
 }
 
@@ -151,22 +491,285 @@ wwd_result_t host_rtos_set_semaphore(host_semaphore_type_t* semaphore, wiced_boo
  */
 wwd_result_t host_rtos_deinit_semaphore(host_semaphore_type_t* semaphore)
 {
-  if (semaphore != NULL) {
+  if (semaphore != NULL && semaphore->sema != NULL) {
+
+    semaDestroy(semaphore->sema);
+    semaphore->sema = NULL;
+  }
+
+  return WWD_SUCCESS;
+}
+
+
+/*
+ * Mutex priority inheritance needs to know which task
+ * waits for which mutex, how many mutexes each task holds
+ * and the priority task had before it was boosted. That is kept
+ * in a small table for tasks that hold or wait for a mutex.
+ * All mutex state is protected by scheduler lock.
+ */
+#define MUTEX_INHERIT (POSCFG_FEATURE_GETPRIORITY && POSCFG_FEATURE_SETPRIORITY)
+
+#ifndef WDCFG_MAX_MUTEX_TASKS
+#define WDCFG_MAX_MUTEX_TASKS 8
+#endif
+
+#if MUTEX_INHERIT
+
+typedef struct {
+
+  POSTASK_t          task;
+  VAR_t              basePriority;
+  int                held;
+  host_mutex_type_t* waitingOn;
+} MutexTask;
+
+static MutexTask mutexTasks[WDCFG_MAX_MUTEX_TASKS];
+
+/*
+ * Find task from table, optionally adding it. Base priority
+ * is sampled when task gets into table, before it can be boosted.
+ * If table is full task just doesn't take part in inheritance.
+ */
+static MutexTask* mutexTask(POSTASK_t task, bool add)
+{
+  MutexTask* unused = NULL;
+  int        i;
+
+  if (task == NULL)
+    return NULL;
+
+  for (i = 0; i < WDCFG_MAX_MUTEX_TASKS; i++) {
+
+    if (mutexTasks[i].task == task)
+      return &mutexTasks[i];
+
+    if (unused == NULL && mutexTasks[i].task == NULL)
+      unused = &mutexTasks[i];
+  }
+
+  if (!add || unused == NULL)
+    return NULL;
+
+  unused->task         = task;
+  unused->basePriority = posTaskGetPriority(task);
+  unused->held         = 0;
+  unused->waitingOn    = NULL;
+  return unused;
+}
+
+static void mutexTaskRelease(MutexTask* t)
+{
+  if (t != NULL && t->held == 0 && t->waitingOn == NULL)
+    t->task = NULL;
+}
+
+/*
+ * Set task priority to highest of its base priority and
+ * priorities of tasks waiting for mutexes it holds. If task
+ * is itself waiting for a mutex, the change is passed on to
+ * owner of that mutex, and so on. Depth is limited so that
+ * a deadlock cycle doesn't hang here.
+ */
+static void mutexTaskUpdate(MutexTask* t)
+{
+  int depth;
+  int i;
+
+  for (depth = 0; t != NULL && depth < WDCFG_MAX_MUTEX_TASKS; depth++) {
+
+    VAR_t priority = t->basePriority;
+
+    for (i = 0; i < WDCFG_MAX_MUTEX_TASKS; i++) {
+
+      MutexTask* w = &mutexTasks[i];
+
+      if (w->task != NULL && w->waitingOn != NULL && w->waitingOn->owner == t->task) {
+
+        VAR_t p = posTaskGetPriority(w->task);
+        if (p > priority)
+          priority = p;
+      }
+    }
+
+    if (posTaskGetPriority(t->task) == priority)
+      break;
+
+    posTaskSetPriority(t->task, priority);
+    t = (t->waitingOn != NULL) ? mutexTask(t->waitingOn->owner, false) : NULL;
+  }
+}
+
+#endif
+
+/*
+ * Create mutex.
+ */
+wwd_result_t host_rtos_init_mutex(host_mutex_type_t* mutex)
+{
+  mutex->owner   = NULL;
+  mutex->waiters = 0;
+  mutex->sema    = semaCreate(0, "wwdmtx");
+  if (mutex->sema == NULL)
+    return WWD_SEMAPHORE_ERROR;
+
+  STAT_ADD(mutexes, peakMutexes, 1);
+  return WWD_SUCCESS;
+}
+
+/*
+ * Lock mutex, waiting at most timeout_ms. Owner is checked and
+ * set with scheduler locked, so there is no window where mutex
+ * is taken but has no owner. Semaphore is used only to sleep
+ * while mutex is owned by someone else. Owner (and owners of
+ * mutexes it is waiting for) get priority of this task until
+ * they unlock.
+ */
+wwd_result_t wdLockMutexTimeout(host_mutex_type_t* mutex, uint32_t timeout_ms)
+{
+  POSTASK_t    self     = nosTaskGetCurrent();
+  UINT_t       ticks    = TMO2TICKS(timeout_ms);
+  JIF_t        deadline = jiffies + ticks;
+  JIF_t        left;
+  wwd_result_t result   = WWD_SUCCESS;
+#if MUTEX_INHERIT
+  MutexTask*   me;
+#endif
 
-    nosSemaDestroy(*semaphore);
-    *semaphore = NULL;
+  P_ASSERT("Mutex is not recursive.", mutex->owner != self);
+
+  posTaskSchedLock();
+#if MUTEX_INHERIT
+  me = mutexTask(self, true);
+#endif
+
+  while (mutex->owner != NULL) {
+
+    if (ticks == INFINITE)
+      left = INFINITE;
+    else {
+
+      left = deadline - jiffies;
+      if (left == 0 || left > ticks) {
+
+        result = WWD_TIMEOUT;
+        break;
+      }
+    }
+
+#if MUTEX_INHERIT
+    if (me != NULL) {
+
+      me->waitingOn = mutex;
+      mutexTaskUpdate(mutexTask(mutex->owner, false));
+    }
+#endif
+
+    ++mutex->waiters;
+    posTaskSchedUnlock();
+
+    nosSemaWait(mutex->sema, (UINT_t)left);
+
+    posTaskSchedLock();
+    --mutex->waiters;
+
+#if MUTEX_INHERIT
+    if (me != NULL)
+      me->waitingOn = NULL;
+#endif
   }
 
+  if (result == WWD_SUCCESS) {
+
+    mutex->owner = self;
+#if MUTEX_INHERIT
+    if (me != NULL) {
+
+/*
+ * Inherit priority of remaining waiters.
+ */
+      ++me->held;
+      mutexTaskUpdate(me);
+    }
+#endif
+  }
+#if MUTEX_INHERIT
+  else {
+
+/*
+ * Owner doesn't need priority of this task anymore.
+ */
+    mutexTaskUpdate(mutexTask(mutex->owner, false));
+    mutexTaskRelease(me);
+  }
+#endif
+
+  posTaskSchedUnlock();
+  return result;
+}
+
+/*
+ * Lock mutex.
+ */
+wwd_result_t host_rtos_lock_mutex(host_mutex_type_t* mutex)
+{
+  return wdLockMutexTimeout(mutex, WDCFG_MUTEX_TIMEOUT);
+}
+
+/*
+ * Unlock mutex. Priority drops back to task base priority,
+ * or to highest waiter of other mutexes it still holds.
+ */
+wwd_result_t host_rtos_unlock_mutex(host_mutex_type_t* mutex)
+{
+  POSTASK_t  self = nosTaskGetCurrent();
+#if MUTEX_INHERIT
+  MutexTask* me;
+#endif
+
+  P_ASSERT("Mutex unlocked by owner.", mutex->owner == self);
+
+  posTaskSchedLock();
+  mutex->owner = NULL;
+
+#if MUTEX_INHERIT
+  me = mutexTask(self, false);
+  if (me != NULL) {
+
+    --me->held;
+    mutexTaskUpdate(me);
+    mutexTaskRelease(me);
+  }
+#endif
+
+  if (mutex->waiters > 0)
+    nosSemaSignal(mutex->sema);
+
+  posTaskSchedUnlock();
   return WWD_SUCCESS;
 }
 
+/*
+ * Destroy mutex.
+ */
+wwd_result_t host_rtos_deinit_mutex(host_mutex_type_t* mutex)
+{
+  if (mutex->sema != NULL) {
+
+    semaDestroy(mutex->sema);
+    mutex->sema = NULL;
+    STAT_SUB(mutexes, 1);
+  }
+
+  return WWD_SUCCESS;
+}
 
 /*
  * Get time in milliseconds since RTOS start.
  */
 wwd_time_t host_rtos_get_time(void)
 {
-  return (wwd_time_t) (jiffies * (1000 / HZ));
+  return (wwd_time_t)wdTimeMs();
 }
 
 
@@ -175,10 +778,138 @@ wwd_time_t host_rtos_get_time(void)
  */
 wwd_result_t host_rtos_delay_milliseconds(uint32_t ms)
 {
-  nosTaskSleep(MS(ms));
+  nosTaskSleep(wdMsToTicks(ms));
   return WWD_SUCCESS;
 }
 
+#define QUEUE_BARRIER() __sync_synchronize()
+
+/*
+ * Queue sides are lock-free as long as a single task
+ * uses them, so a queue with one producer and one consumer
+ * needs no locking. When another task starts to use a side,
+ * side switches to locking scheduler for good. Switching
+ * task waits until owner has left its lock-free section.
+ * Returns true if scheduler was locked.
+ */
+static bool queueEnter(host_queue_side_t* side)
+{
+  POSTASK_t self = nosTaskGetCurrent();
+
+  if (!side->shared && side->owner == self) {
+
+    side->busy = 1;
+    QUEUE_BARRIER();
+    if (!side->shared)
+      return false;
+
+    side->busy = 0;
+  }
+
+  posTaskSchedLock();
+  if (side->owner == NULL)
+    side->owner = self;
+  else if (side->owner != self && !side->shared) {
+
+    side->shared = 1;
+    QUEUE_BARRIER();
+    posTaskSchedUnlock();
+
+    while (side->busy)
+      nosTaskSleep(1);
+
+    posTaskSchedLock();
+  }
+
+  return true;
+}
+
+static void queueLeave(host_queue_side_t* side, bool locked)
+{
+  if (locked)
+    posTaskSchedUnlock();
+  else {
+
+    QUEUE_BARRIER();
+    side->busy = 0;
+  }
+}
+
+/*
+ * Wait until queue condition might have changed.
+ * Waiter count is incremented before checking condition
+ * again, so that other side signals semaphore if it changes
+ * state after the check. Returns false if timeout expired.
+ */
+static bool queueWait(host_queue_side_t* side,
+                      volatile uint8_t* waiters,
+                      POSSEMA_t sema,
+                      bool (*ready)(host_queue_type_t*),
+                      host_queue_type_t* queue,
+                      UINT_t timeout,
+                      JIF_t deadline)
+{
+  JIF_t left;
+  bool  ok = true;
+  bool  isReady;
+  bool  locked;
+
+  if (timeout == 0)
+    return false;
+
+  if (timeout == INFINITE)
+    left = INFINITE;
+  else {
+
+    left = deadline - jiffies;
+    if (left == 0 || left > timeout)
+      return false;
+  }
+
+  locked = queueEnter(side);
+  ++*waiters;
+  QUEUE_BARRIER();
+  isReady = ready(queue);
+  queueLeave(side, locked);
+
+  if (!isReady)
+    ok = nosSemaWait(sema, (UINT_t)left) == 0;
+
+  locked = queueEnter(side);
+  --*waiters;
+  queueLeave(side, locked);
+
+/*
+ * A signal given just before timeout can be left
+ * in semaphore. It only causes one extra check later.
+ */
+  return ok || ready(queue);
+}
+
+/*
+ * Indexes run from 0 to 2 * slots - 1 so that
+ * full and empty queues can be told apart.
+ */
+static uint32_t queueUsed(host_queue_type_t* queue)
+{
+  return (queue->tail + 2 * queue->slots - queue->head) % (2 * queue->slots);
+}
+
+static uint32_t queueNext(host_queue_type_t* queue, uint32_t index)
+{
+  return (index + 1) % (2 * queue->slots);
+}
+
+static bool queueHasSpace(host_queue_type_t* queue)
+{
+  return queueUsed(queue) < queue->slots;
+}
+
+static bool queueHasItems(host_queue_type_t* queue)
+{
+  return queue->tail != queue->head;
+}
+
 /*
  * Create queue.
  */
@@ -187,10 +918,32 @@ wwd_result_t host_rtos_init_queue(host_queue_type_t* queue,
                                   uint32_t bufferSize,
                                   uint32_t messageSize )
 {
-  *queue = uosRingCreate(messageSize, bufferSize / messageSize);
-  if (*queue == NULL)
+  P_ASSERT("Queue buffer given.", buffer != NULL);
+  P_ASSERT("Queue message size valid.", messageSize > 0);
+
+  queue->buffer      = buffer;
+  queue->messageSize = messageSize;
+  queue->slots       = bufferSize / messageSize;
+  queue->head        = 0;
+  queue->tail        = 0;
+  queue->producerWaiters = 0;
+  queue->consumerWaiters = 0;
+  queue->maxUsed     = 0;
+  memset(&queue->producer, '\0', sizeof(queue->producer));
+  memset(&queue->consumer, '\0', sizeof(queue->consumer));
+
+  P_ASSERT("Queue buffer holds at least one message.", queue->slots > 0);
+
+  queue->spaces = semaCreate(0, "wwdq");
+  queue->items  = semaCreate(0, "wwdq");
+  if (queue->spaces == NULL || queue->items == NULL) {
+
+    host_rtos_deinit_queue(queue);
     return WWD_QUEUE_ERROR;
+  }
 
+  STAT_ADD(queues, peakQueues, 1);
+  track((void**)queues, WDCFG_MAX_QUEUES, queue);
   return WWD_SUCCESS;
 }
 
@@ -201,8 +954,38 @@ wwd_result_t host_rtos_push_to_queue(host_queue_type_t* queue,
                                      void* message,
                                      uint32_t timeout)
 {
-  if (!uosRingPut(*queue, message, TMO2TICKS(timeout)))
-    return WWD_TIMEOUT;
+  UINT_t ticks    = TMO2TICKS(timeout);
+  JIF_t  deadline = jiffies + ticks;
+  bool   wake;
+  bool   locked;
+
+  while (1) {
+
+    locked = queueEnter(&queue->producer);
+    if (queueHasSpace(queue)) {
+
+      memcpy(queue->buffer + (queue->tail % queue->slots) * queue->messageSize,
+             message,
+             queue->messageSize);
+      QUEUE_BARRIER();
+      queue->tail = queueNext(queue, queue->tail);
+      if (queueUsed(queue) > queue->maxUsed)
+        queue->maxUsed = queueUsed(queue);
+
+      QUEUE_BARRIER();
+      wake = queue->consumerWaiters > 0;
+      queueLeave(&queue->producer, locked);
+      break;
+    }
+
+    queueLeave(&queue->producer, locked);
+    if (!queueWait(&queue->producer, &queue->producerWaiters, queue->spaces, queueHasSpace, queue, ticks, deadline))
+      return WWD_TIMEOUT;
+  }
+
+  WD_TRACE(WD_TRACE_QUEUE_PUSH, queue);
+  if (wake)
+    nosSemaSignal(queue->items);
 
   return WWD_SUCCESS;
 }
@@ -214,8 +997,35 @@ wwd_result_t host_rtos_pop_from_queue(host_queue_type_t* queue,
                                       void* message,
                                       uint32_t timeout)
 {
-  if (!uosRingGet(*queue, message, TMO2TICKS(timeout)))
-    return WWD_TIMEOUT;
+  UINT_t ticks    = TMO2TICKS(timeout);
+  JIF_t  deadline = jiffies + ticks;
+  bool   wake;
+  bool   locked;
+
+  while (1) {
+
+    locked = queueEnter(&queue->consumer);
+    if (queueHasItems(queue)) {
+
+      memcpy(message,
+             queue->buffer + (queue->head % queue->slots) * queue->messageSize,
+             queue->messageSize);
+      QUEUE_BARRIER();
+      queue->head = queueNext(queue, queue->head);
+      QUEUE_BARRIER();
+      wake = queue->producerWaiters > 0;
+      queueLeave(&queue->consumer, locked);
+      break;
+    }
+
+    queueLeave(&queue->consumer, locked);
+    if (!queueWait(&queue->consumer, &queue->consumerWaiters, queue->items, queueHasItems, queue, ticks, deadline))
+      return WWD_TIMEOUT;
+  }
+
+  WD_TRACE(WD_TRACE_QUEUE_POP, queue);
+  if (wake)
+    nosSemaSignal(queue->spaces);
 
   return WWD_SUCCESS;
 }
@@ -225,6 +1035,90 @@ wwd_result_t host_rtos_pop_from_queue(host_queue_type_t* queue,
  */
 wwd_result_t host_rtos_deinit_queue(host_queue_type_t* queue)
 {
-  uosRingDestroy(*queue);
+  if (queue->spaces != NULL && queue->items != NULL)
+    STAT_SUB(queues, 1);
+
+  untrack((void**)queues, WDCFG_MAX_QUEUES, queue);
+  if (queue->spaces != NULL) {
+
+    semaDestroy(queue->spaces);
+    queue->spaces = NULL;
+  }
+
+  if (queue->items != NULL) {
+
+    semaDestroy(queue->items);
+    queue->items = NULL;
+  }
+
   return WWD_SUCCESS;
 }
+
+/*
+ * Diagnostics.
+ */
+void wdGetRtosStats(WdRtosStats* stats)
+{
+#if POSCFG_TASKSTACKTYPE == 0
+  stackReap();
+#endif
+
+  posTaskSchedLock();
+  *stats = rtosStats;
+  posTaskSchedUnlock();
+}
+
+/*
+ * Count bytes of painted stack that have not been touched.
+ */
+static uint32_t stackUnused(const host_thread_type_t* thread)
+{
+  uint32_t i;
+
+  for (i = 0; i < thread->stackSize && thread->stack[i] == STACK_PAINT; i++);
+  return i;
+}
+
+int wdGetThreadStats(WdThreadStats* stats, int max)
+{
+  int i;
+  int count = 0;
+
+  posTaskSchedLock();
+  for (i = 0; i < WDCFG_MAX_THREADS && count < max; i++) {
+
+    if (threads[i] == NULL)
+      continue;
+
+    stats[count].name      = threads[i]->name;
+    stats[count].stackSize = threads[i]->stackSize;
+    stats[count].stackUsed = (threads[i]->stack != NULL) ? threads[i]->stackSize - stackUnused(threads[i]) : 0;
+    ++count;
+  }
+
+  posTaskSchedUnlock();
+  return count;
+}
+
+int wdGetQueueStats(WdQueueStats* stats, int max)
+{
+  int i;
+  int count = 0;
+
+  posTaskSchedLock();
+  for (i = 0; i < WDCFG_MAX_QUEUES && count < max; i++) {
+
+    if (queues[i] == NULL)
+      continue;
+
+    stats[count].slots       = queues[i]->slots;
+    stats[count].messageSize = queues[i]->messageSize;
+    stats[count].used        = queueUsed(queues[i]);
+    stats[count].maxUsed     = queues[i]->maxUsed;
+    stats[count].lockFree    = !queues[i]->producer.shared && !queues[i]->consumer.shared;
+    ++count;
+  }
+
+  posTaskSchedUnlock();
+  return count;
+}
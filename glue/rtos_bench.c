@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "wwd_constants.h"
+#include "RTOS/wwd_rtos_interface.h"
+
+/*
+ * Microbenchmarks for host_rtos primitives. They use
+ * the same interface as WWD, so results show the cost of
+ * RTOS mapping as seen by WWD thread. Compiled in if
+ * WDCFG_RTOS_BENCH is set to 1.
+ */
+#ifndef WDCFG_RTOS_BENCH
+#define WDCFG_RTOS_BENCH 0
+#endif
+
+#if WDCFG_RTOS_BENCH
+
+#ifndef WDCFG_RTOS_BENCH_STACK
+#define WDCFG_RTOS_BENCH_STACK 1024
+#endif
+
+#ifndef WDCFG_RTOS_BENCH_PRIORITY
+#define WDCFG_RTOS_BENCH_PRIORITY RTOS_DEFAULT_THREAD_PRIORITY
+#endif
+
+#define QUEUE_SLOTS 8
+#define DELAY_ROUNDS 10
+
+static const uint32_t queueSizes[WD_BENCH_QUEUE_SIZES] = { 4, 16, 64 };
+
+static host_thread_type_t    helper;
+static host_semaphore_type_t ping;
+static host_semaphore_type_t pong;
+static host_queue_type_t     queue;
+static uint32_t              queueBuf[QUEUE_SLOTS * 64 / sizeof(uint32_t)];
+static int                   benchRounds;
+
+/*
+ * Intervals are measured with 64-bit cycle counter,
+ * as long runs wrap 32-bit one (on host port
+ * in about four seconds).
+ */
+static uint32_t cyclesPer(uint64_t cycles, uint32_t count)
+{
+  return count > 0 ? (uint32_t)(cycles / count) : 0;
+}
+
+/*
+ * Semaphore ping-pong.
+ */
+static void pongThread(uint32_t arg)
+{
+  int i;
+
+  for (i = 0; i < benchRounds; i++) {
+
+    host_rtos_get_semaphore(&ping, NEVER_TIMEOUT, WICED_FALSE);
+    host_rtos_set_semaphore(&pong, WICED_FALSE);
+  }
+
+  host_rtos_finish_thread(&helper);
+}
+
+static bool benchSema(WdRtosBench* result)
+{
+  uint64_t start;
+  int      i;
+
+  if (host_rtos_init_semaphore(&ping) != WWD_SUCCESS)
+    return false;
+
+  if (host_rtos_init_semaphore(&pong) != WWD_SUCCESS) {
+
+    host_rtos_deinit_semaphore(&ping);
+    return false;
+  }
+
+  if (host_rtos_create_thread(&helper, pongThread, "bench", NULL,
+                              WDCFG_RTOS_BENCH_STACK, WDCFG_RTOS_BENCH_PRIORITY) != WWD_SUCCESS) {
+
+    host_rtos_deinit_semaphore(&ping);
+    host_rtos_deinit_semaphore(&pong);
+    return false;
+  }
+
+  start = wdCycles64();
+  for (i = 0; i < benchRounds; i++) {
+
+    host_rtos_set_semaphore(&ping, WICED_FALSE);
+    host_rtos_get_semaphore(&pong, NEVER_TIMEOUT, WICED_FALSE);
+  }
+
+  result->semaRoundTrip = cyclesPer(wdCycles64() - start, benchRounds);
+
+  host_rtos_join_thread(&helper);
+  host_rtos_delete_terminated_thread(&helper);
+  host_rtos_deinit_semaphore(&ping);
+  host_rtos_deinit_semaphore(&pong);
+  return true;
+}
+
+/*
+ * Queue throughput, helper thread pushes
+ * and caller pops messages.
+ */
+static void producerThread(uint32_t size)
+{
+  uint32_t msg[64 / sizeof(uint32_t)];
+  int      i;
+
+  memset(msg, '\0', size);
+  for (i = 0; i < benchRounds; i++)
+    host_rtos_push_to_queue(&queue, msg, NEVER_TIMEOUT);
+
+  host_rtos_finish_thread(&helper);
+}
+
+static bool benchQueue(WdRtosBench* result, int n)
+{
+  uint32_t msg[64 / sizeof(uint32_t)];
+  uint32_t size = queueSizes[n];
+  uint64_t start;
+  int      i;
+
+  if (host_rtos_init_queue(&queue, queueBuf, QUEUE_SLOTS * size, size) != WWD_SUCCESS)
+    return false;
+
+  if (host_rtos_create_thread_with_arg(&helper, producerThread, "bench", NULL,
+                                       WDCFG_RTOS_BENCH_STACK, WDCFG_RTOS_BENCH_PRIORITY,
+                                       size) != WWD_SUCCESS) {
+
+    host_rtos_deinit_queue(&queue);
+    return false;
+  }
+
+/*
+ * Thread creation is not part of measurement. If
+ * producer preempted caller, it has at most filled the queue.
+ */
+  start = wdCycles64();
+  for (i = 0; i < benchRounds; i++)
+    host_rtos_pop_from_queue(&queue, msg, NEVER_TIMEOUT);
+
+  result->queueSizes[n]  = size;
+  result->queueCycles[n] = cyclesPer(wdCycles64() - start, benchRounds);
+
+  host_rtos_join_thread(&helper);
+  host_rtos_delete_terminated_thread(&helper);
+  host_rtos_deinit_queue(&queue);
+  return true;
+}
+
+/*
+ * Timer granularity and delay accuracy.
+ */
+static void benchTime(WdRtosBench* result)
+{
+  wwd_time_t t0;
+  wwd_time_t t1;
+  uint64_t   start;
+  uint32_t   calls = 0;
+  int        i;
+
+  t0 = host_rtos_get_time();
+  while ((t1 = host_rtos_get_time()) == t0);
+
+  start = wdCycles64();
+  while ((t0 = host_rtos_get_time()) == t1)
+    ++calls;
+
+  result->timeCycles = cyclesPer(wdCycles64() - start, calls);
+  result->timeStep   = t0 - t1;
+
+  start = wdCycles64();
+  for (i = 0; i < DELAY_ROUNDS; i++)
+    host_rtos_delay_milliseconds(1);
+
+  result->delayUs = (uint32_t)((uint64_t)cyclesPer(wdCycles64() - start, DELAY_ROUNDS) * 1000000 / WD_CYCLES_PER_SEC);
+}
+
+int wdRtosBenchmark(WdRtosBench* result, int rounds)
+{
+  int n;
+
+  memset(result, '\0', sizeof(*result));
+  benchRounds = rounds;
+
+  if (!benchSema(result))
+    return -1;
+
+  for (n = 0; n < WD_BENCH_QUEUE_SIZES; n++)
+    if (!benchQueue(result, n))
+      return -1;
+
+  benchTime(result);
+  return 0;
+}
+
+#else
+
+int wdRtosBenchmark(WdRtosBench* result, int rounds)
+{
+  memset(result, '\0', sizeof(*result));
+  return -1;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/def.h"
+#include "lwip/prot/ethernet.h"
+
+/*
+ * Early receive classifier. Frames are checked against
+ * ethertype allow-list and per-class token bucket rate limits
+ * before they are passed to lwIP, so traffic that would be
+ * discarded anyway costs as little CPU as possible.
+ */
+#if WDCFG_RX_FILTER
+
+typedef struct {
+
+  uint16_t rate;      // frames per second, WD_RX_UNLIMITED = no limit
+  uint16_t burst;
+  uint32_t tokens;    // frames * HZ
+  JIF_t    last;
+} RateLimit;
+
+static uint16_t         etherTypes[WD_RX_FILTER_ETHERTYPES];
+static int              etherTypeCount;
+static RateLimit        limits[WD_RX_CLASS_COUNT] = {
+
+  [0 ... WD_RX_CLASS_COUNT - 1] = { .rate = WD_RX_UNLIMITED }
+};
+
+static WdRxFilterStats  stats;
+
+/*
+ * Limit refill time so that multiplication below
+ * doesn't overflow.
+ */
+#define MAX_REFILL_TICKS 32768
+
+static bool rateAllow(RateLimit* rl)
+{
+  JIF_t    now = jiffies;
+  uint32_t elapsed;
+  uint32_t max;
+
+  if (rl->rate == WD_RX_UNLIMITED)
+    return true;
+
+  elapsed  = (uint32_t)(now - rl->last);
+  rl->last = now;
+  if (elapsed > MAX_REFILL_TICKS)
+    elapsed = MAX_REFILL_TICKS;
+
+  max = (uint32_t)rl->burst * HZ;
+  rl->tokens += elapsed * rl->rate;
+  if (rl->tokens > max)
+    rl->tokens = max;
+
+  if (rl->tokens < HZ)
+    return false;
+
+  rl->tokens -= HZ;
+  return true;
+}
+
+static WdRxClass classify(const uint8_t* dst, uint16_t type)
+{
+  if (!(dst[0] & 1))
+    return WD_RX_UNICAST;
+
+  if ((dst[0] & dst[1] & dst[2] & dst[3] & dst[4] & dst[5]) == 0xff)
+    return (type == ETHTYPE_ARP) ? WD_RX_BROADCAST_ARP : WD_RX_BROADCAST;
+
+  if (dst[0] == 0x01 && dst[1] == 0x00 && dst[2] == 0x5e)
+    return WD_RX_MULTICAST_IPV4;
+
+  if (dst[0] == 0x33 && dst[1] == 0x33)
+    return WD_RX_MULTICAST_IPV6;
+
+  return WD_RX_MULTICAST;
+}
+
+/*
+ * Called from receive path. Returns false if frame
+ * should be dropped.
+ */
+bool wdRxFilter(struct pbuf* p)
+{
+  const uint8_t* frame;
+  uint16_t       type;
+  WdRxClass      cls;
+  int            i;
+
+  if (p->len < ETH_PAD_SIZE + SIZEOF_ETH_HDR) {
+
+    ++stats.runts;
+    return false;
+  }
+
+  frame = (const uint8_t*)p->payload + ETH_PAD_SIZE;
+  type  = (frame[12] << 8) | frame[13];
+
+  if (etherTypeCount > 0) {
+
+    for (i = 0; i < etherTypeCount; i++)
+      if (etherTypes[i] == type)
+        break;
+
+    if (i == etherTypeCount) {
+
+      ++stats.etherTypeDropped;
+      return false;
+    }
+
+    ++stats.etherTypeHits[i];
+  }
+
+  cls = classify(frame, type);
+  if (!rateAllow(&limits[cls])) {
+
+    ++stats.classDropped[cls];
+    return false;
+  }
+
+  ++stats.classPassed[cls];
+  return true;
+}
+
+void wdRxFilterSetEtherTypes(const uint16_t* types, int count)
+{
+  P_ASSERT("too many ethertypes", count <= WD_RX_FILTER_ETHERTYPES);
+
+  posTaskSchedLock();
+  etherTypeCount = 0;
+  memcpy(etherTypes, types, count * sizeof(uint16_t));
+  memset(stats.etherTypeHits, '\0', sizeof(stats.etherTypeHits));
+  etherTypeCount = count;
+  posTaskSchedUnlock();
+}
+
+void wdRxFilterSetRate(WdRxClass cls, uint16_t rate, uint16_t burst)
+{
+  RateLimit* rl = &limits[cls];
+
+  P_ASSERT("valid class", cls < WD_RX_CLASS_COUNT);
+
+  posTaskSchedLock();
+  rl->rate   = rate;
+  rl->burst  = burst;
+  rl->tokens = (uint32_t)burst * HZ;
+  rl->last   = jiffies;
+  posTaskSchedUnlock();
+}
+
+void wdGetRxFilterStats(WdRxFilterStats* st)
+{
+  *st = stats;
+}
+
+#else
+
+void wdRxFilterSetEtherTypes(const uint16_t* types, int count)
+{
+}
+
+void wdRxFilterSetRate(WdRxClass cls, uint16_t rate, uint16_t burst)
+{
+}
+
+void wdGetRxFilterStats(WdRxFilterStats* st)
+{
+  memset(st, '\0', sizeof(*st));
+}
+
+#endif
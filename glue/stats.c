@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+#include "lwip/stats.h"
+
+/*
+ * Machine-readable dump of driver counters.
+ */
+
+typedef struct {
+
+  char* buf;
+  int   size;
+  int   len;
+} Output;
+
+static void out(Output* o, const char* fmt, ...)
+{
+  va_list ap;
+  int     n;
+  int     room = o->size - o->len;
+
+  if (room < 0)
+    room = 0;
+
+  va_start(ap, fmt);
+  n = vsnprintf(room > 0 ? o->buf + o->len : NULL, room, fmt, ap);
+  va_end(ap);
+
+  if (n > 0)
+    o->len += n;
+}
+
+static void outU32s(Output* o, const char* name, const uint32_t* values, int count)
+{
+  int i;
+
+  out(o, "\"%s\":[", name);
+  for (i = 0; i < count; i++)
+    out(o, "%s%lu", i ? "," : "", (unsigned long)values[i]);
+
+  out(o, "]");
+}
+
+/*
+ * 64-bit values are printed as two 32-bit parts,
+ * as small printf implementations might not support %llu.
+ */
+static void outU64(Output* o, const char* name, uint64_t value)
+{
+  if (value >> 32)
+    out(o, "\"%s\":%lu%09lu", name,
+        (unsigned long)(value / 1000000000), (unsigned long)(value % 1000000000));
+  else
+    out(o, "\"%s\":%lu", name, (unsigned long)value);
+}
+
+void wdGetTrafficStats(WdTrafficStats* stats)
+{
+  *stats = wdTraffic;
+}
+
+int wdStatsFormat(char* buf, int size)
+{
+  Output           o = { buf, size, 0 };
+  WdTrafficStats   traffic;
+  WdBufferStats    buffers;
+  WdRxRingStats    ring;
+  WdMulticastStats mcast;
+  WdRxFilterStats  filter;
+  WdOffloadStats   offload;
+  WdPowersaveStats pm;
+  WdRtosStats      rtos;
+
+  wdGetTrafficStats(&traffic);
+  wdGetBufferStats(&buffers);
+  wdGetRxRingStats(&ring);
+  wdGetMulticastStats(&mcast);
+  wdGetRxFilterStats(&filter);
+  wdGetOffloadStats(&offload);
+  wdGetPowersaveStats(&pm);
+  wdGetRtosStats(&rtos);
+
+  out(&o, "{\"hz\":%lu,\"jiffies\":%lu,\"cyclesPerSec\":%lu,",
+      (unsigned long)HZ, (unsigned long)jiffies, (unsigned long)WD_CYCLES_PER_SEC);
+
+  out(&o, "\"traffic\":{\"txFrames\":%lu,\"txBytes\":%lu,",
+      (unsigned long)traffic.txFrames, (unsigned long)traffic.txBytes);
+  outU64(&o, "txCycles", traffic.txCycles);
+  out(&o, ",\"rxFrames\":%lu,\"rxBytes\":%lu,",
+      (unsigned long)traffic.rxFrames, (unsigned long)traffic.rxBytes);
+  outU64(&o, "rxCycles", traffic.rxCycles);
+  out(&o, "},");
+
+#if MEMP_STATS
+  const struct stats_mem* pool = lwip_stats.memp[MEMP_PBUF_POOL];
+
+  out(&o, "\"pbufPool\":{\"avail\":%lu,\"used\":%lu,\"max\":%lu,\"err\":%lu},",
+      (unsigned long)pool->avail, (unsigned long)pool->used,
+      (unsigned long)pool->max, (unsigned long)pool->err);
+#endif
+
+  out(&o, "\"buffers\":{\"tx\":{\"allocs\":%lu,\"failures\":%lu,\"limitHits\":%lu,\"waits\":%lu},",
+      (unsigned long)buffers.tx.allocs, (unsigned long)buffers.tx.failures,
+      (unsigned long)buffers.tx.limitHits, (unsigned long)buffers.tx.waits);
+  out(&o, "\"rx\":{\"allocs\":%lu,\"failures\":%lu,\"limitHits\":%lu,\"waits\":%lu}},",
+      (unsigned long)buffers.rx.allocs, (unsigned long)buffers.rx.failures,
+      (unsigned long)buffers.rx.limitHits, (unsigned long)buffers.rx.waits);
+
+  out(&o, "\"rxRing\":{\"enqueued\":%lu,\"dropped\":%lu,\"batches\":%lu,\"maxOccupancy\":%lu,\"scheduleFailures\":%lu},",
+      (unsigned long)ring.enqueued, (unsigned long)ring.dropped,
+      (unsigned long)ring.batches, (unsigned long)ring.maxOccupancy,
+      (unsigned long)ring.scheduleFailures);
+
+  out(&o, "\"txQueueDepth\":%lu,", (unsigned long)wdTxQueueDepth());
+
+  out(&o, "\"multicast\":{\"entries\":%lu,\"allMulti\":%lu,\"fwUpdates\":%lu,\"hostDropped\":%lu},",
+      (unsigned long)mcast.entries, (unsigned long)mcast.allMulti,
+      (unsigned long)mcast.fwUpdates, (unsigned long)mcast.hostDropped);
+
+  out(&o, "\"rxFilter\":{\"runts\":%lu,\"etherTypeDropped\":%lu,",
+      (unsigned long)filter.runts, (unsigned long)filter.etherTypeDropped);
+  outU32s(&o, "classPassed", filter.classPassed, WD_RX_CLASS_COUNT);
+  out(&o, ",");
+  outU32s(&o, "classDropped", filter.classDropped, WD_RX_CLASS_COUNT);
+  out(&o, "},");
+
+  out(&o, "\"offload\":{\"arpOffload\":%lu,\"packetFilters\":%lu,\"busWakeups\":%lu},",
+      (unsigned long)offload.arpOffload, (unsigned long)offload.packetFilters,
+      (unsigned long)offload.busWakeups);
+
+  out(&o, "\"powersave\":{\"state\":%lu,\"transitions\":%lu,",
+      (unsigned long)pm.state, (unsigned long)pm.transitions);
+  outU32s(&o, "time", pm.time, WD_PM_COUNT);
+  out(&o, "},");
+
+  out(&o, "\"rtos\":{\"semaphores\":%lu,\"peakSemaphores\":%lu,\"queues\":%lu,\"stackBytes\":%lu}}",
+      (unsigned long)rtos.semaphores, (unsigned long)rtos.peakSemaphores,
+      (unsigned long)rtos.queues, (unsigned long)rtos.stackBytes);
+
+  return o.len;
+}
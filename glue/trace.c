@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <picoos.h>
+#include <string.h>
+
+#include "wd_glue.h"
+
+/*
+ * Lock-free trace ring. Writers claim a slot with atomic
+ * increment, so events can be recorded from tasks and
+ * interrupts. Oldest events are overwritten. Ring layout
+ * is also the dump format, so it can be saved by debugger
+ * (dump memory of wdTraceRing) or with wdTraceDump().
+ */
+#if WDCFG_TRACE
+
+#ifndef WDCFG_TRACE_LEN
+#define WDCFG_TRACE_LEN 256
+#endif
+
+#if (WDCFG_TRACE_LEN & (WDCFG_TRACE_LEN - 1)) != 0
+#error WDCFG_TRACE_LEN must be power of two
+#endif
+
+#define TRACE_FLAG_ISR 0x01
+
+/*
+ * Tasks are given small sequential ids when they record
+ * their first event. Tasks beyond WDCFG_TRACE_TASKS share
+ * TRACE_TASK_OTHER. Interrupts use id 0.
+ */
+#ifndef WDCFG_TRACE_TASKS
+#define WDCFG_TRACE_TASKS 16
+#endif
+
+#define TRACE_TASK_OTHER 0xffff
+
+typedef struct {
+
+  uint32_t cycles;
+  uint32_t arg;
+  uint8_t  event;
+  uint8_t  flags;
+  uint16_t task;
+} TraceEntry;
+
+typedef struct {
+
+  char              magic[4];
+  uint32_t          cyclesPerSec;
+  uint32_t          len;
+  volatile uint32_t head;
+  TraceEntry        entry[WDCFG_TRACE_LEN];
+} TraceRing;
+
+/*
+ * Cycle counter frequency is set here if it is
+ * constant, otherwise by wdTraceInit().
+ */
+TraceRing wdTraceRing = {
+
+  .magic = { 'W', 'D', 'T', '1' },
+#ifdef WD_CYCLES_RATE_CONSTANT
+  .cyclesPerSec = WD_CYCLES_PER_SEC,
+#endif
+  .len   = WDCFG_TRACE_LEN
+};
+
+static NOSTASK_t        traceTasks[WDCFG_TRACE_TASKS];
+static volatile uint8_t traceTaskCount;
+
+static uint16_t taskId(void)
+{
+  NOSTASK_t task = nosTaskGetCurrent();
+  int       i;
+
+  for (i = 0; i < traceTaskCount; i++)
+    if (traceTasks[i] == task)
+      return i + 1;
+
+/*
+ * New task. Check again under lock, another
+ * task may have been added meanwhile.
+ */
+  posTaskSchedLock();
+  for (; i < traceTaskCount; i++)
+    if (traceTasks[i] == task)
+      break;
+
+  if (i == traceTaskCount) {
+
+    if (i == WDCFG_TRACE_TASKS) {
+
+      posTaskSchedUnlock();
+      return TRACE_TASK_OTHER;
+    }
+
+    traceTasks[i] = task;
+    traceTaskCount = i + 1;
+  }
+
+  posTaskSchedUnlock();
+  return i + 1;
+}
+
+void wdTraceInit(void)
+{
+  wdTraceRing.cyclesPerSec = WD_CYCLES_PER_SEC;
+}
+
+void wdTrace(WdTraceEvent event, uint32_t arg)
+{
+  bool        isr  = posInInterrupt_g;
+  uint16_t    task = isr ? 0 : taskId();
+  uint32_t    slot = __atomic_fetch_add(&wdTraceRing.head, 1, __ATOMIC_RELAXED);
+  TraceEntry* e    = &wdTraceRing.entry[slot & (WDCFG_TRACE_LEN - 1)];
+
+  e->cycles = wdCycles();
+  e->arg    = arg;
+  e->event  = event;
+  e->flags  = isr ? TRACE_FLAG_ISR : 0;
+  e->task   = task;
+}
+
+int wdTraceDump(void* buf, int size)
+{
+  if (size < (int)sizeof(wdTraceRing))
+    return -1;
+
+  wdTraceRing.cyclesPerSec = WD_CYCLES_PER_SEC;
+  memcpy(buf, &wdTraceRing, sizeof(wdTraceRing));
+  return sizeof(wdTraceRing);
+}
+
+void wdTraceReset(void)
+{
+  wdTraceRing.cyclesPerSec = WD_CYCLES_PER_SEC;
+  wdTraceRing.head = 0;
+  memset(wdTraceRing.entry, '\0', sizeof(wdTraceRing.entry));
+}
+
+#else
+
+void wdTraceInit(void)
+{
+}
+
+int wdTraceDump(void* buf, int size)
+{
+  return -1;
+}
+
+void wdTraceReset(void)
+{
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#ifndef _WD_GLUE_H
+#define _WD_GLUE_H
+
+/*
+ * Internal definitions shared by glue modules.
+ */
+
+#include <picoos.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wd_cycles.h"
+#include "wd_trace.h"
+#include "wiced-driver.h"
+
+/*
+ * Latency histograms are compiled in only
+ * if WDCFG_LATENCY_HIST is set to 1.
+ */
+#ifndef WDCFG_LATENCY_HIST
+#define WDCFG_LATENCY_HIST 0
+#endif
+
+#if WDCFG_LATENCY_HIST
+
+void wdHistogramAdd(WdHistogramId id, uint32_t cycles);
+
+#define WD_HIST_START(var)      uint32_t var = wdCycles()
+#define WD_HIST_END(id, var)    wdHistogramAdd(id, wdCycles() - (var))
+
+#else
+
+#define WD_HIST_START(var)      do {} while (0)
+#define WD_HIST_END(id, var)    do {} while (0)
+
+#endif
+
+/*
+ * Cycle counter extended to 64 bits (clock.c), for
+ * measuring intervals that may be longer than one wrap.
+ */
+uint64_t wdCycles64(void);
+
+/*
+ * Convert milliseconds to ticks, rounding up so
+ * that timeouts are never shorter than requested.
+ */
+static inline UINT_t wdMsToTicks(uint32_t ms)
+{
+  uint64_t ticks = ((uint64_t)ms * HZ + 999) / 1000;
+
+  return (ticks >= (UINT_t)INFINITE) ? (UINT_t)INFINITE - 1 : (UINT_t)ticks;
+}
+
+/*
+ * Convert ticks to milliseconds, works also
+ * when HZ is not a divisor of 1000.
+ */
+static inline uint32_t wdTicksToMs(JIF_t ticks)
+{
+  return (uint32_t)((uint64_t)ticks * 1000 / HZ);
+}
+
+/*
+ * Early receive filter (rx_filter.c), compiled in
+ * if WDCFG_RX_FILTER is set to 1.
+ */
+#ifndef WDCFG_RX_FILTER
+#define WDCFG_RX_FILTER 0
+#endif
+
+struct pbuf;
+
+bool wdRxFilter(struct pbuf* p);
+
+/*
+ * Number of WWD interfaces, used to size per-interface tables.
+ */
+#define WD_INTERFACES (WWD_ETHERNET_INTERFACE + 1)
+
+/*
+ * Worker task for firmware configuration (management.c).
+ * Work items are bits, posting same item again before
+ * worker runs has no effect.
+ */
+#define WD_WORK_MULTICAST 0x01
+#define WD_WORK_OFFLOAD   0x02
+
+void wdWorkerInit(void);
+void wdWorkerPost(uint32_t work);
+
+/*
+ * Multicast address tables (multicast.c).
+ */
+err_t wdMulticastJoin(wwd_interface_t interface, const uint8_t* mac);
+err_t wdMulticastLeave(wwd_interface_t interface, const uint8_t* mac);
+bool  wdMulticastAccept(wwd_interface_t interface, const uint8_t* mac);
+bool  wdMulticastSync(void);
+void  wdMulticastRestore(void);
+
+/*
+ * Firmware offloads (offload.c).
+ */
+#ifndef WDCFG_ARP_OFFLOAD
+#define WDCFG_ARP_OFFLOAD 0
+#endif
+
+#ifndef WDCFG_PACKET_FILTER
+#define WDCFG_PACKET_FILTER 0
+#endif
+
+extern volatile uint32_t wdBusWakeups;
+
+void wdOffloadInit(struct netif* netif);
+void wdOffloadAddressChanged(struct netif* netif);
+void wdOffloadRemoved(struct netif* netif);
+void wdOffloadSync(void);
+void wdOffloadRestore(void);
+
+/*
+ * Traffic counters (wlan_if.c).
+ */
+extern WdTrafficStats wdTraffic;
+
+uint32_t wdTxQueueDepth(void);
+
+#endif /* _WD_GLUE_H */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#ifndef _WD_TRACE_H
+#define _WD_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Binary event trace, compiled in only if
+ * WDCFG_TRACE is set to 1. Event numbers must match
+ * tools/wdtrace.py.
+ */
+#ifndef WDCFG_TRACE
+#define WDCFG_TRACE 0
+#endif
+
+typedef enum {
+
+  WD_TRACE_BUF_GET = 1,   // arg: direction << 16 | size
+  WD_TRACE_BUF_RELEASE,   // arg: direction << 16 | size
+  WD_TRACE_TX,            // arg: frame length
+  WD_TRACE_TX_QUEUED,     // arg: frame length
+  WD_TRACE_RX,            // arg: frame length
+  WD_TRACE_SEMA_WAIT,     // arg: semaphore
+  WD_TRACE_SEMA_WAKE,     // arg: semaphore
+  WD_TRACE_SEMA_SIGNAL,   // arg: semaphore
+  WD_TRACE_QUEUE_PUSH,    // arg: queue
+  WD_TRACE_QUEUE_POP,     // arg: queue
+  WD_TRACE_ISR,           // arg: 0
+  WD_TRACE_SEMA_TIMEOUT   // arg: semaphore
+} WdTraceEvent;
+
+/*
+ * Record cycle counter frequency in trace ring header,
+ * called by wdSystemInit() after clocks are set up.
+ */
+void wdTraceInit(void);
+
+#if WDCFG_TRACE
+
+void wdTrace(WdTraceEvent event, uint32_t arg);
+
+#define WD_TRACE(event, arg) wdTrace(event, (uint32_t)(uintptr_t)(arg))
+
+#else
+
+#define WD_TRACE(event, arg) do {} while (0)
+
+#endif
+
+#endif /* _WD_TRACE_H */
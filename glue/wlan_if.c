@@ -36,7 +36,7 @@
 #include <string.h>
 #include <stdlib.h>
 
-#include "wiced-driver.h"
+#include "wd_glue.h"
 
 #include "lwip/opt.h"
 #include "lwip/def.h"
@@ -46,7 +46,10 @@
 #include "lwip/snmp.h"
 #include "lwip/ethip6.h"
 #include "netif/etharp.h"
+#include "netif/ethernet.h"
 #include "lwip/mld6.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
 
 #include "wwd_wifi.h"
 #include "wwd_eapol.h"
@@ -55,11 +58,122 @@
 #include "wwd_assert.h"
 #include "wiced_constants.h"
 #include "wwd_bus_protocol.h"
+#include "RTOS/wwd_rtos_interface.h"
+
+/*
+ * Set to 1 if bus layer can transmit pbuf chains
+ * (walking them with host_buffer_get_next_piece()).
+ * Otherwise chained frames are copied into single buffer.
+ */
+#ifndef WDCFG_BUS_SCATTER_GATHER
+#define WDCFG_BUS_SCATTER_GATHER 0
+#endif
+
+/*
+ * Number of frames that can be queued per interface
+ * while it is not ready to transmit and how long (ms)
+ * they are allowed to wait there.
+ */
+#ifndef WDCFG_TX_QUEUE_LEN
+#define WDCFG_TX_QUEUE_LEN 4
+#endif
+
+#if WDCFG_TX_QUEUE_LEN < 1
+#error "WDCFG_TX_QUEUE_LEN must be at least 1."
+#endif
+
+#ifndef WDCFG_TX_QUEUE_MAX_AGE
+#define WDCFG_TX_QUEUE_MAX_AGE 2000
+#endif
+
+/*
+ * While frames are queued, tcpip thread tries to send
+ * them this often (ms), so that they don't have to wait
+ * for other traffic after interface becomes ready.
+ */
+#ifndef WDCFG_TX_QUEUE_RETRY
+#define WDCFG_TX_QUEUE_RETRY 20
+#endif
+
+/*
+ * If WDCFG_RX_RING_LEN is nonzero, received frames are
+ * passed from WWD thread to tcpip thread through a ring
+ * of this size (must be power of 2) instead of posting
+ * each of them using netif->input. Tcpip thread processes
+ * at most WDCFG_RX_BATCH frames per wakeup. Frames
+ * are passed to netif->input from tcpip thread, except
+ * tcpip_input, which is bypassed to avoid posting them again.
+ */
+#ifndef WDCFG_RX_RING_LEN
+#define WDCFG_RX_RING_LEN 0
+#endif
+
+#ifndef WDCFG_RX_BATCH
+#define WDCFG_RX_BATCH 8
+#endif
+
+#if (WDCFG_RX_RING_LEN & (WDCFG_RX_RING_LEN - 1)) != 0
+#error "WDCFG_RX_RING_LEN must be power of 2."
+#endif
 
 /* Define those to better describe your network interface. */
 #define IFNAME0 'w'
 #define IFNAME1 'l'
 
+typedef struct {
+
+  struct pbuf*   frame[WDCFG_TX_QUEUE_LEN];
+  wwd_time_t     queued[WDCFG_TX_QUEUE_LEN];
+  int            head;
+  int            count;
+  volatile bool  flushPending;
+  bool           retryPending;
+  WdTxQueueStats stats;
+} TxQueue;
+
+#define IFACE_ARG(i) ((void*)(uintptr_t)(i))
+#define ARG_IFACE(a) ((wwd_interface_t)(uintptr_t)(a))
+
+static TxQueue txQueue[WD_INTERFACES];
+
+/*
+ * Netif for each wiced interface, for fast lookup
+ * on receive path.
+ */
+static struct netif* wdNetif[WD_INTERFACES];
+
+/*
+ * Frame, byte and CPU cycle counters.
+ */
+WdTrafficStats wdTraffic;
+
+#if WDCFG_RX_RING_LEN > 0
+
+/*
+ * Single producer (WWD thread), single consumer
+ * (tcpip thread) ring for received frames.
+ */
+typedef struct {
+
+  struct pbuf*  p;
+  struct netif* netif;
+} RxSlot;
+
+typedef struct {
+
+  RxSlot            slot[WDCFG_RX_RING_LEN];
+  volatile unsigned head;
+  volatile unsigned tail;
+  volatile bool     scheduled;
+  WdRxRingStats     stats;
+} RxRing;
+
+static RxRing rxRing;
+
+#define RX_RING_BARRIER() __sync_synchronize()
+
+#endif
+
 #if LWIP_IGMP
 static err_t igmp_mac_filter( struct netif *netif, ip_addr_t *group, u8_t action );
 #endif
@@ -82,7 +196,7 @@ low_level_init(struct netif *netif)
   // set MAC hardware address
   netif->hwaddr_len = ETHARP_HWADDR_LEN;
   result = wwd_wifi_get_mac_address((wiced_mac_t*)netif->hwaddr, (wwd_interface_t)netif->state);
-  P_ASSERT("wlan mac address valid", result != WWD_SUCCESS);
+  P_ASSERT("wlan mac address valid", result == WWD_SUCCESS);
   
   // maximum transfer unit
   netif->mtu = WICED_PAYLOAD_MTU;
@@ -107,22 +221,71 @@ low_level_init(struct netif *netif)
 #endif
 }
 
+/*
+ * Check if interface is able to send frames now.
+ */
+static bool
+ready_to_transceive(struct netif *netif)
+{
+  return ((wiced_interface_t)netif->state) == WICED_ETHERNET_INTERFACE ||
+         wwd_wifi_is_ready_to_transceive((wwd_interface_t)netif->state) == WWD_SUCCESS;
+}
+
+/*
+ * Get reference to frame that can be held after lwIP
+ * returns from linkoutput. Frame is copied into a single
+ * buffer if it refers to volatile data (PBUF_NEEDS_COPY) or
+ * if it is chained and bus layer can handle only contiguous
+ * frames. Copy is allocated with room for wiced link headers,
+ * just like lwIP does.
+ */
+static struct pbuf*
+frame_hold(struct pbuf *p)
+{
+  bool copy = false;
+
+#if !WDCFG_BUS_SCATTER_GATHER
+  copy = p->next != NULL;
+#endif
+
+#ifdef PBUF_NEEDS_COPY
+  copy = copy || PBUF_NEEDS_COPY(p);
+#endif
+
+  if (copy) {
+
+    struct pbuf* q;
+
+    q = pbuf_alloc(PBUF_RAW_TX, p->tot_len, PBUF_RAM);
+    if (q == NULL) {
+
+      LINK_STATS_INC(link.memerr);
+      return NULL;
+    }
+
+    pbuf_copy(q, p);
+    return q;
+  }
+
+  pbuf_ref(p);
+  return p;
+}
+
 /**
- * Send packet to network.
+ * Hand packet over to wiced layer. Interface must
+ * be ready to transceive.
  *
  * @param netif the lwip network interface structure for this ethernetif
  * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
  * @return ERR_OK if the packet could be sent
- *         an err_t value if the packet couldn't be sent
+ *         ERR_MEM if packet couldn't be copied
  */
-
 static err_t
-low_level_output(struct netif *netif, struct pbuf *p)
+send_frame(struct netif *netif, struct pbuf *p)
 {
-  if (((wiced_interface_t)netif->state) == WICED_ETHERNET_INTERFACE ||
-      wwd_wifi_is_ready_to_transceive((wwd_interface_t)netif->state) == WWD_SUCCESS) {
-    
-    pbuf_ref(p);
+  p = frame_hold(p);
+  if (p == NULL)
+    return ERR_MEM;
 
 #if ETH_PAD_SIZE
 
@@ -133,39 +296,405 @@ low_level_output(struct netif *netif, struct pbuf *p)
  * overlaps with the space used by wiced link headers
  * but LwIP never actually touches it so this is not a problem.
  */
-    pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+  pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
     
 #endif
 
-    LWIP_ASSERT("Must be single pbuf", ((p->next == NULL) && (( p->tot_len == p->len ))));
-    wwd_network_send_ethernet_data(p, (wwd_interface_t)netif->state);
-
-    MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
-    if (((u8_t*)p->payload)[0] & 1) {
+/*
+ * Update statistics before handing packet over, a copied
+ * frame is owned by wiced layer after that.
+ */
+  MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+  if (((u8_t*)p->payload)[0] & 1) {
     
-      // broadcast or multicast packet
-      MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
-    }
-    else {
+    // broadcast or multicast packet
+    MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
+  }
+  else {
     
-      // unicast packet
-      MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
-    }
+    // unicast packet
+    MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
+  }
+
+  LINK_STATS_INC(link.xmit);
+
+  WD_HIST_START(start);
+  wwd_network_send_ethernet_data(p, (wwd_interface_t)netif->state);
+  WD_HIST_END(WD_HIST_TX_SEND, start);
+  return ERR_OK;
+}
+
+/*
+ * Drop frames that have been waiting too long
+ * in transmit queue.
+ */
+static void
+tx_queue_expire(TxQueue* txq, wwd_time_t now)
+{
+  while (txq->count > 0 && now - txq->queued[txq->head] > WDCFG_TX_QUEUE_MAX_AGE) {
 
-    LINK_STATS_INC(link.xmit);
-    return ERR_OK;
+    pbuf_free(txq->frame[txq->head]);
+    txq->frame[txq->head] = NULL;
+    txq->head = (txq->head + 1) % WDCFG_TX_QUEUE_LEN;
+    --txq->count;
+    ++txq->stats.expired;
   }
-  else {
-  
-    return ERR_INPROGRESS;
+
+  txq->stats.depth = txq->count;
+}
+
+static void tx_queue_retry(void* ctx);
+
+/*
+ * Start retry timer if there are queued frames.
+ */
+static void
+tx_queue_retry_start(wwd_interface_t interface)
+{
+  TxQueue* txq = &txQueue[interface];
+
+  if (txq->count > 0 && !txq->retryPending) {
+
+    txq->retryPending = true;
+    sys_timeout(WDCFG_TX_QUEUE_RETRY, tx_queue_retry, IFACE_ARG(interface));
   }
 }
 
+/*
+ * Send frames that were queued while interface was not ready.
+ * Must be called in tcpip thread context. If some are left,
+ * retry timer is started.
+ */
+static void
+tx_queue_flush(struct netif *netif)
+{
+  wwd_interface_t interface = (wwd_interface_t)netif->state;
+  TxQueue*        txq = &txQueue[interface];
+  wwd_time_t      now = host_rtos_get_time();
+  wwd_time_t      wait;
+
+  tx_queue_expire(txq, now);
+  while (txq->count > 0 && ready_to_transceive(netif)) {
+
+    if (send_frame(netif, txq->frame[txq->head]) != ERR_OK)
+      break;
+
+    wait = now - txq->queued[txq->head];
+    txq->stats.totalWait += wait;
+    if (wait > txq->stats.maxWait)
+      txq->stats.maxWait = wait;
+
+    pbuf_free(txq->frame[txq->head]);
+    txq->frame[txq->head] = NULL;
+    txq->head = (txq->head + 1) % WDCFG_TX_QUEUE_LEN;
+    --txq->count;
+  }
+
+  txq->stats.depth = txq->count;
+  tx_queue_retry_start(interface);
+}
+
+static void
+tx_queue_retry(void* ctx)
+{
+  wwd_interface_t interface = ARG_IFACE(ctx);
+
+  txQueue[interface].retryPending = false;
+  if (wdNetif[interface] != NULL)
+    tx_queue_flush(wdNetif[interface]);
+}
+
+/*
+ * Netif is looked up when callback runs, as
+ * it might have been removed after posting.
+ */
+static void
+tx_queue_flush_callback(void* ctx)
+{
+  wwd_interface_t interface = ARG_IFACE(ctx);
+
+  txQueue[interface].flushPending = false;
+  if (wdNetif[interface] != NULL)
+    tx_queue_flush(wdNetif[interface]);
+}
+
+/*
+ * Drop queued frames of removed netif.
+ */
+static void
+tx_queue_clear(wwd_interface_t interface)
+{
+  TxQueue* txq = &txQueue[interface];
+
+  if (txq->retryPending) {
+
+    sys_untimeout(tx_queue_retry, IFACE_ARG(interface));
+    txq->retryPending = false;
+  }
+
+  while (txq->count > 0) {
+
+    pbuf_free(txq->frame[txq->head]);
+    txq->frame[txq->head] = NULL;
+    txq->head = (txq->head + 1) % WDCFG_TX_QUEUE_LEN;
+    --txq->count;
+    ++txq->stats.dropped;
+  }
+
+  txq->stats.depth = 0;
+}
+
+/*
+ * Put frame into transmit queue to wait until
+ * interface becomes ready.
+ */
+static err_t
+tx_queue_add(struct netif *netif, struct pbuf *p)
+{
+  TxQueue*   txq = &txQueue[(wwd_interface_t)netif->state];
+  wwd_time_t now = host_rtos_get_time();
+  int        slot;
+
+  tx_queue_expire(txq, now);
+  if (txq->count >= WDCFG_TX_QUEUE_LEN) {
+
+    ++txq->stats.dropped;
+    LINK_STATS_INC(link.drop);
+    return ERR_MEM;
+  }
+
+  p = frame_hold(p);
+  if (p == NULL)
+    return ERR_MEM;
+
+  WD_TRACE(WD_TRACE_TX_QUEUED, p->tot_len);
+  slot = (txq->head + txq->count) % WDCFG_TX_QUEUE_LEN;
+  txq->frame[slot]  = p;
+  txq->queued[slot] = now;
+  ++txq->count;
+
+  ++txq->stats.queued;
+  txq->stats.depth = txq->count;
+  if (txq->count > txq->stats.maxDepth)
+    txq->stats.maxDepth = txq->count;
+
+  tx_queue_retry_start((wwd_interface_t)netif->state);
+  return ERR_OK;
+}
+
 /**
- * WICED stack calls this function when packet has been
- * received from network.
+ * Send packet to network. If interface is not ready (association
+ * in progress or no bus credits) packet is queued.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
+ * @return ERR_OK if the packet could be sent or was queued
+ *         ERR_MEM if transmit queue is full
  */
-void host_network_process_ethernet_data(wiced_buffer_t p, wwd_interface_t interface)
+static err_t
+low_level_output(struct netif *netif, struct pbuf *p)
+{
+  TxQueue* txq    = &txQueue[(wwd_interface_t)netif->state];
+  uint32_t cycles = wdCycles();
+  uint16_t len    = p->tot_len;
+  err_t    err;
+
+  WD_HIST_START(start);
+  WD_TRACE(WD_TRACE_TX, len);
+
+  if (txq->count > 0)
+    tx_queue_flush(netif);
+
+  if (txq->count == 0 && ready_to_transceive(netif))
+    err = send_frame(netif, p);
+  else
+    err = tx_queue_add(netif, p);
+
+  WD_HIST_END(WD_HIST_TX_OUTPUT, start);
+
+  ++wdTraffic.txFrames;
+  wdTraffic.txBytes  += len;
+  wdTraffic.txCycles += wdCycles() - cycles;
+  return err;
+}
+
+void wdGetTxQueueStats(struct netif *netif, WdTxQueueStats* stats)
+{
+  *stats = txQueue[(wwd_interface_t)netif->state].stats;
+}
+
+/*
+ * Number of frames waiting in transmit queues.
+ */
+uint32_t wdTxQueueDepth(void)
+{
+  uint32_t depth = 0;
+  int      i;
+
+  for (i = 0; i < WD_INTERFACES; i++)
+    depth += txQueue[i].count;
+
+  return depth;
+}
+
+#if WDCFG_RX_RING_LEN > 0
+
+static void rx_ring_drain(void* ctx);
+
+/*
+ * Ask tcpip thread to drain receive ring, unless
+ * already done. Returns false if callback could not
+ * be posted.
+ */
+static bool
+rx_ring_schedule(void)
+{
+  if (rxRing.scheduled)
+    return true;
+
+  rxRing.scheduled = true;
+  if (tcpip_callback_with_block(rx_ring_drain, NULL, 0) == ERR_OK)
+    return true;
+
+  rxRing.scheduled = false;
+  ++rxRing.stats.scheduleFailures;
+  return false;
+}
+
+/*
+ * Pass frame from ring to lwIP in tcpip thread. Tcpip_input
+ * would just post it to tcpip thread again, so call
+ * what it calls for ethernet netifs instead.
+ */
+static err_t
+rx_ring_input(struct pbuf* p, struct netif* netif)
+{
+  if (netif->input == tcpip_input)
+    return ethernet_input(p, netif);
+
+  return netif->input(p, netif);
+}
+
+/*
+ * Process a batch of received frames in tcpip thread.
+ */
+static void
+rx_ring_drain(void* ctx)
+{
+  RxSlot* slot;
+  int     count = 0;
+
+/*
+ * Clear flag before looking at ring, so that frame
+ * added after this gets another callback if needed.
+ */
+  rxRing.scheduled = false;
+  RX_RING_BARRIER();
+
+  do {
+
+    count = 0;
+    while (rxRing.head != rxRing.tail && count < WDCFG_RX_BATCH) {
+
+      slot = &rxRing.slot[rxRing.head & (WDCFG_RX_RING_LEN - 1)];
+
+      if (slot->netif == NULL || rx_ring_input(slot->p, slot->netif) != ERR_OK) {
+
+        LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
+        pbuf_free(slot->p);
+      }
+
+      slot->p = NULL;
+      RX_RING_BARRIER();
+      ++rxRing.head;
+      ++count;
+    }
+
+    if (count > 0)
+      ++rxRing.stats.batches;
+
+    rxRing.stats.occupancy = rxRing.tail - rxRing.head;
+
+/*
+ * If next batch cannot be scheduled, process it now
+ * instead of leaving frames into ring.
+ */
+  } while (rxRing.head != rxRing.tail && !rx_ring_schedule());
+}
+
+/*
+ * Add received frame to ring, called by WWD thread.
+ * Netif is looked up again with scheduler locked, so that
+ * netif_removed() either sees the frame in ring or frame
+ * is dropped here. If drain callback cannot be posted, WWD
+ * thread doesn't wait: ring stays unscheduled and posting is
+ * retried on next put (or by drain that is running).
+ * Returns false if frame was dropped.
+ */
+static bool
+rx_ring_put(struct pbuf* p, wwd_interface_t interface)
+{
+  unsigned      used = rxRing.tail - rxRing.head;
+  struct netif* netif;
+  RxSlot*       slot;
+
+  if (used >= WDCFG_RX_RING_LEN) {
+
+    ++rxRing.stats.dropped;
+    LINK_STATS_INC(link.drop);
+    pbuf_free(p);
+    rx_ring_schedule();
+    return false;
+  }
+
+  posTaskSchedLock();
+  netif = wdNetif[interface];
+  if (netif != NULL) {
+
+    slot = &rxRing.slot[rxRing.tail & (WDCFG_RX_RING_LEN - 1)];
+    slot->p     = p;
+    slot->netif = netif;
+    RX_RING_BARRIER();
+    ++rxRing.tail;
+    RX_RING_BARRIER();
+  }
+
+  posTaskSchedUnlock();
+
+  if (netif == NULL) {
+
+    pbuf_free(p);
+    return false;
+  }
+
+  ++used;
+  ++rxRing.stats.enqueued;
+  rxRing.stats.occupancy = used;
+  if (used > rxRing.stats.maxOccupancy)
+    rxRing.stats.maxOccupancy = used;
+
+  rx_ring_schedule();
+
+  return true;
+}
+
+#endif
+
+void wdGetRxRingStats(WdRxRingStats* stats)
+{
+#if WDCFG_RX_RING_LEN > 0
+  *stats = rxRing.stats;
+#else
+  memset(stats, '\0', sizeof(*stats));
+#endif
+}
+
+/*
+ * Pass received frame to lwIP. Returns false if
+ * frame was dropped.
+ */
+static bool
+rx_input(wiced_buffer_t p, wwd_interface_t interface)
 {
 #if ETH_PAD_SIZE
 
@@ -180,15 +709,35 @@ void host_network_process_ethernet_data(wiced_buffer_t p, wwd_interface_t interf
   struct netif* netif;
   uint8_t       result;
 
-  for (netif = netif_list; (netif != NULL) && (netif->state != (void*)interface); netif = netif->next) {
-  }
-
+  netif = ((unsigned int)interface < WD_INTERFACES) ? wdNetif[interface] : NULL;
   if (netif == NULL) {
 
     result = pbuf_free(p);
     LWIP_ASSERT("pbuf_free", (result != 0));
     p = NULL;
-    return;
+    return false;
+  }
+
+#if WDCFG_RX_FILTER
+
+  if (!wdRxFilter(p)) {
+
+    pbuf_free(p);
+    return false;
+  }
+
+#endif
+
+/*
+ * Drop unwanted multicast frames if firmware
+ * is in allmulti mode.
+ */
+  const uint8_t* dst = (const uint8_t*)p->payload + ETH_PAD_SIZE;
+
+  if ((dst[0] & 1) && !eth_addr_cmp((const struct eth_addr*)dst, &ethbroadcast) && !wdMulticastAccept(interface, dst)) {
+
+    pbuf_free(p);
+    return false;
   }
 
   MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
@@ -205,16 +754,144 @@ void host_network_process_ethernet_data(wiced_buffer_t p, wwd_interface_t interf
 
   LINK_STATS_INC(link.recv);
 
+/*
+ * Receiving traffic is a good hint that interface might
+ * be ready to transmit again. Ask tcpip thread to flush
+ * pending frames.
+ */
+  TxQueue* txq = &txQueue[interface];
+
+  if (txq->count > 0 && !txq->flushPending && ready_to_transceive(netif)) {
+
+    txq->flushPending = true;
+    if (tcpip_callback_with_block(tx_queue_flush_callback, IFACE_ARG(interface), 0) != ERR_OK)
+      txq->flushPending = false;
+  }
+
   // EAPOL packets are not handled by netif->input, eventually
   // LWIP_HOOK_UNKNOWN_ETH_PROTOCOL should be setup to process them.
+#if WDCFG_RX_RING_LEN > 0
+
+  return rx_ring_put(p, interface);
+
+#else
+
   if (netif->input(p, netif) != ERR_OK) {
 
     LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
     pbuf_free(p);
-    p = NULL;
+    return false;
   }
+
+  return true;
+
+#endif
 }
 
+/**
+ * WICED stack calls this function when packet has been
+ * received from network.
+ */
+void host_network_process_ethernet_data(wiced_buffer_t p, wwd_interface_t interface)
+{
+  uint32_t cycles = wdCycles();
+  uint16_t len    = p->tot_len;
+
+  WD_HIST_START(start);
+  WD_TRACE(WD_TRACE_RX, len);
+
+/*
+ * Frames dropped by driver are measured separately,
+ * including the cost of freeing the buffer.
+ */
+  if (rx_input(p, interface))
+    WD_HIST_END(WD_HIST_RX_INPUT, start);
+  else
+    WD_HIST_END(WD_HIST_RX_DROP, start);
+
+  ++wdTraffic.rxFrames;
+  wdTraffic.rxBytes  += len;
+  wdTraffic.rxCycles += wdCycles() - cycles;
+}
+
+#if !LWIP_NETIF_EXT_STATUS_CALLBACK && LWIP_NETIF_REMOVE_CALLBACK
+
+/*
+ * Remove callback that was installed before ours,
+ * it is called after driver has forgotten netif.
+ */
+static netif_status_callback_fn prevRemoveCallback[WD_INTERFACES];
+
+#endif
+
+/*
+ * Forget netif when it is removed from lwIP.
+ */
+static void
+netif_removed(struct netif *netif)
+{
+  wwd_interface_t interface = (wwd_interface_t)netif->state;
+  bool            owner;
+
+/*
+ * Scheduler is locked so that WWD thread cannot
+ * put a frame for this netif into ring meanwhile.
+ */
+  posTaskSchedLock();
+  owner = (wdNetif[interface] == netif);
+  if (owner)
+    wdNetif[interface] = NULL;
+
+#if WDCFG_RX_RING_LEN > 0
+
+/*
+ * Frames for this netif that are still in receive
+ * ring are dropped when ring is drained.
+ */
+  unsigned i;
+
+  for (i = rxRing.head; i != rxRing.tail; i++)
+    if (rxRing.slot[i & (WDCFG_RX_RING_LEN - 1)].netif == netif)
+      rxRing.slot[i & (WDCFG_RX_RING_LEN - 1)].netif = NULL;
+
+#endif
+
+  posTaskSchedUnlock();
+  if (owner)
+    tx_queue_clear(interface);
+
+  wdOffloadRemoved(netif);
+
+#if !LWIP_NETIF_EXT_STATUS_CALLBACK && LWIP_NETIF_REMOVE_CALLBACK
+  if (prevRemoveCallback[interface] != NULL)
+    prevRemoveCallback[interface](netif);
+#endif
+}
+
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+
+static void
+netif_ext_callback(struct netif* netif,
+                   netif_nsc_reason_t reason,
+                   const netif_ext_callback_args_t* args)
+{
+  if (netif->linkoutput != low_level_output)
+    return;
+
+  if (reason & LWIP_NSC_NETIF_REMOVED) {
+
+    netif_removed(netif);
+    return;
+  }
+
+  if (reason & LWIP_NSC_IPV4_ADDRESS_CHANGED)
+    wdOffloadAddressChanged(netif);
+}
+
+NETIF_DECLARE_EXT_CALLBACK(extCallback)
+
+#endif
+
 /**
  * Should be called at the beginning of the program to set up the
  * network interface. It calls the function low_level_init() to do the
@@ -265,9 +942,67 @@ ethernetif_init(struct netif *netif)
   /* initialize the hardware */
   low_level_init(netif);
 
+  /* register for receive path lookup */
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+
+  static bool extCallbackAdded = false;
+
+  if (!extCallbackAdded) {
+
+    netif_add_ext_callback(&extCallback, netif_ext_callback);
+    extCallbackAdded = true;
+  }
+
+#elif LWIP_NETIF_REMOVE_CALLBACK
+
+/*
+ * Chain to remove callback that application may have
+ * installed. If application installs one after this, it
+ * must call previous one (netif_removed) too.
+ */
+  if (netif->remove_callback != netif_removed)
+    prevRemoveCallback[(wwd_interface_t)netif->state] = netif->remove_callback;
+
+  netif_set_remove_callback(netif, netif_removed);
+
+#endif
+
+/*
+ * Without either callback netif_remove() for wlan interfaces
+ * is not supported (receive path would use stale netif).
+ */
+
+  wdNetif[(wwd_interface_t)netif->state] = netif;
+  wdWorkerInit();
+  wdOffloadInit(netif);
+
   return ERR_OK;
 }
 
+#if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
+
+/*
+ * Multicast addresses are kept in reference counted
+ * table, which takes care of updating firmware.
+ */
+static err_t mac_filter(struct netif* netif, const uint8_t* mac, u8_t action)
+{
+  wwd_interface_t interface = (wwd_interface_t)netif->state;
+
+  switch (action) {
+  case NETIF_ADD_MAC_FILTER:
+    return wdMulticastJoin(interface, mac);
+
+  case NETIF_DEL_MAC_FILTER:
+    return wdMulticastLeave(interface, mac);
+
+  default:
+    return ERR_VAL;
+  }
+}
+
+#endif
+
 #if LWIP_IGMP
 
 #define MULTICAST_IP_TO_MAC(ip)       { (uint8_t) 0x01,             \
@@ -280,26 +1015,9 @@ ethernetif_init(struct netif *netif)
 
 static err_t igmp_mac_filter(struct netif *netif, ip_addr_t *group, u8_t action)
 {
-  wiced_mac_t mac = { MULTICAST_IP_TO_MAC((uint8_t*)group) };
+  uint8_t mac[] = MULTICAST_IP_TO_MAC((uint8_t*)group);
 
-  switch (action) {
-  case NETIF_ADD_MAC_FILTER:
-    if (wwd_wifi_register_multicast_address(&mac) != WWD_SUCCESS )
-      return ERR_VAL;
-
-    break;
-
-  case NETIF_DEL_MAC_FILTER:
-    if (wwd_wifi_unregister_multicast_address(&mac) != WWD_SUCCESS )
-      return ERR_VAL;
-
-    break;
-
-  default:
-    return ERR_VAL;
-  }
-
-  return ERR_OK;
+  return mac_filter(netif, mac, action);
 }
 
 #endif
@@ -308,34 +1026,17 @@ static err_t igmp_mac_filter(struct netif *netif, ip_addr_t *group, u8_t action)
 
 static err_t mld_mac_filter(struct netif *netif, const ip6_addr_t *group, u8_t action)
 {
-  wiced_mac_t mac;
+  uint8_t  mac[6];
   uint8_t* g = (uint8_t*)&group->addr[3];
 
-  mac.octet[0] = 0x33;
-  mac.octet[1] = 0x33;
-  mac.octet[2] = g[0];
-  mac.octet[3] = g[1];
-  mac.octet[4] = g[2];
-  mac.octet[5] = g[3];
+  mac[0] = 0x33;
+  mac[1] = 0x33;
+  mac[2] = g[0];
+  mac[3] = g[1];
+  mac[4] = g[2];
+  mac[5] = g[3];
 
-  switch (action) {
-  case NETIF_ADD_MAC_FILTER:
-    if (wwd_wifi_register_multicast_address(&mac) != WWD_SUCCESS )
-      return ERR_VAL;
-
-    break;
-
-  case NETIF_DEL_MAC_FILTER:
-    if (wwd_wifi_unregister_multicast_address(&mac) != WWD_SUCCESS )
-      return ERR_VAL;
-
-    break;
-
-  default:
-    return ERR_VAL;
-  }
-
-  return ERR_OK;
+  return mac_filter(netif, mac, action);
 }
 
 #endif
@@ -30,6 +30,7 @@
 
 #include <picoos.h>
 #include <picoos-u.h>
+#include "wwd_constants.h"
 
 #define RTOS_HIGHEST_PRIORITY           (POSCFG_MAX_PRIO_LEVEL - 1)
 #define RTOS_LOWEST_PRIORITY            0
@@ -38,13 +39,118 @@
 #define RTOS_HIGHER_PRIORTIY_THAN(x)    (x < RTOS_HIGHEST_PRIORITY ? (x + 1) : RTOS_HIGHEST_PRIORITY)
 #define RTOS_LOWER_PRIORTIY_THAN(x)     (x > RTOS_LOWEST_PRIORITY ? (x - 1) : RTOS_LOWEST_PRIORITY)
 
+/*
+ * WWD thread stack is allocated from heap by default. If
+ * WDCFG_STATIC_THREAD_STACK is set to 1, WWD passes its own
+ * static stack area (which can be placed into a specific RAM
+ * region by linker script). Needs POSCFG_TASKSTACKTYPE 0.
+ */
+#ifndef WDCFG_STATIC_THREAD_STACK
+#define WDCFG_STATIC_THREAD_STACK 0
+#endif
+
+/*
+ * wwd_thread.c requires exactly one of these: static one
+ * makes it pass wwd_thread_stack array, dynamic one NULL.
+ */
+#if WDCFG_STATIC_THREAD_STACK
+#if POSCFG_TASKSTACKTYPE != 0
+#error "WDCFG_STATIC_THREAD_STACK needs POSCFG_TASKSTACKTYPE 0."
+#endif
+#define RTOS_USE_STATIC_THREAD_STACK
+#else
 #define RTOS_USE_DYNAMIC_THREAD_STACK
-#define WWD_THREAD_STACK_SIZE           (3000)
+#endif
+
+#ifndef WDCFG_THREAD_STACK_SIZE
+#define WDCFG_THREAD_STACK_SIZE         3000
+#endif
+
+#define WWD_THREAD_STACK_SIZE           (WDCFG_THREAD_STACK_SIZE)
+
+/*
+ * Thread signals completion semaphore when exiting
+ * so that it can be joined without polling.
+ */
+typedef struct {
+
+  POSTASK_t   task;
+  POSSEMA_t   done;
+  void      (*entry)(uint32_t);
+  uint32_t    arg;
+  const char* name;
+  uint8_t*    stack;
+  uint32_t    stackSize;
+  uint8_t     stackAllocated;
+} host_thread_type_t;
+
+/*
+ * Semaphore, optionally with coalesced signalling from interrupts.
+ */
+typedef struct {
+
+  POSSEMA_t         sema;
+  uint8_t           coalesce;
+  volatile uint8_t  isrPending;
+  uint32_t          isrCycles;
+} host_semaphore_type_t;
+
+/*
+ * Make interrupt signals of semaphore coalesce into one
+ * pending wakeup. Called by WWD for its thread semaphore.
+ */
+void wdCoalesceIsrSignals(host_semaphore_type_t* semaphore);
+
+/*
+ * Mutex with transitive priority inheritance. Owner is
+ * the lock itself, semaphore is used only for sleeping
+ * so that lock can time out.
+ */
+typedef struct {
+
+  POSSEMA_t          sema;
+  volatile POSTASK_t owner;
+  volatile uint8_t   waiters;
+} host_mutex_type_t;
+
+/*
+ * Lock mutex with timeout given by caller instead
+ * of WDCFG_MUTEX_TIMEOUT.
+ */
+wwd_result_t wdLockMutexTimeout(host_mutex_type_t* mutex, uint32_t timeout_ms);
+
+/*
+ * Producer or consumer side of queue. Side is lock-free
+ * while only one task has used it.
+ */
+typedef struct {
+
+  volatile POSTASK_t owner;
+  volatile uint8_t   shared;
+  volatile uint8_t   busy;
+} host_queue_side_t;
+
+/*
+ * Queue is built on buffer given by caller. Semaphores are
+ * used only when a task must block, waiter counts tell
+ * other side when it must signal.
+ */
+typedef struct {
+
+  uint8_t*          buffer;
+  uint32_t          messageSize;
+  uint32_t          slots;
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint8_t  producerWaiters;
+  volatile uint8_t  consumerWaiters;
+  uint32_t          maxUsed;
+  host_queue_side_t producer;
+  host_queue_side_t consumer;
+  POSSEMA_t         spaces;
+  POSSEMA_t         items;
+} host_queue_type_t;
 
-typedef POSTASK_t host_thread_type_t;
-typedef POSSEMA_t host_semaphore_type_t;
-typedef POSMUTEX_t host_mutex_type_t;
-typedef UosRing* host_queue_type_t;
 typedef struct {
 
     uint8_t dummy;
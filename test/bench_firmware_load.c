@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#include "wd_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "platform/wwd_resource_interface.h"
+
+/*
+ * Firmware load time. Reads firmware file through resource
+ * interface the same way WWD does during boot, using
+ * different transfer sizes. If compressed container of same
+ * image is given as argument (packed by tools/wdzpack.py), its
+ * decompression throughput is measured too. With --write file
+ * argument program only writes the image for packing.
+ *
+ * Each transfer size is also loaded with baseline loader that
+ * works like the original one did: open, seek, read and close
+ * for every chunk WWD asks for. Number of chunks and read
+ * system calls (from /proc/self/io) are reported for both.
+ *
+ * With --real raw packed arguments real chip firmware and its
+ * packed version are loaded instead and checked to be byte-exact
+ * with original. Test is skipped if files are not available.
+ */
+
+#ifndef WDCFG_FIRMWARE
+#define WDCFG_FIRMWARE "43362A2.bin"
+#endif
+
+#define FIRMWARE_SIZE (220 * 1024)
+#define IMAGE_MAX     (512 * 1024)
+#define ROUNDS        10
+
+extern const char* firmwarePath[];
+
+static uint8_t  image[IMAGE_MAX];
+static uint8_t  loaded[IMAGE_MAX];
+static uint32_t imageSize = FIRMWARE_SIZE;
+static uint32_t loadSize;
+static uint32_t loadChunks;
+static uint32_t baselineSyscalls;
+
+/*
+ * Something that looks a bit like firmware: code-like
+ * repeating patterns mixed with random data.
+ */
+static void makeImage(uint8_t* data, uint32_t size)
+{
+  uint32_t seed = 1;
+  uint32_t i;
+
+  for (i = 0; i < size; i++) {
+
+    seed = seed * 1103515245 + 12345;
+    data[i] = ((i / 64) % 3 == 0) ? (uint8_t)(seed >> 16) : (uint8_t)(i * 7);
+  }
+}
+
+static bool writeFile(const char* name, const uint8_t* data, uint32_t size)
+{
+  FILE* f = fopen(name, "wb");
+  bool  ok;
+
+  if (f == NULL)
+    return false;
+
+  ok = fwrite(data, 1, size, f) == size;
+  return fclose(f) == 0 && ok;
+}
+
+/*
+ * Baseline loader, same as resource interface was
+ * before firmware file was kept open.
+ */
+static bool baselineSize(uint32_t* size)
+{
+  char        buf[80];
+  struct stat st;
+
+  snprintf(buf, sizeof(buf), "%s/%s", firmwarePath[0], WDCFG_FIRMWARE);
+  ++baselineSyscalls;
+  if (stat(buf, &st) == -1)
+    return false;
+
+  *size = st.st_size;
+  return true;
+}
+
+static bool baselineRead(uint32_t offset, void* buffer, uint32_t len, uint32_t* n)
+{
+  char buf[80];
+  int  fd;
+  int  r;
+
+  snprintf(buf, sizeof(buf), "%s/%s", firmwarePath[0], WDCFG_FIRMWARE);
+  ++baselineSyscalls;
+  fd = open(buf, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  baselineSyscalls += 3;
+  if (lseek(fd, offset, SEEK_SET) == -1)
+    r = 0;
+  else
+    r = read(fd, buffer, len);
+
+  close(fd);
+  if (r == -1)
+    return false;
+
+  *n = r;
+  return true;
+}
+
+/*
+ * Read whole firmware using given transfer size, either
+ * via resource interface or baseline loader.
+ * Returns elapsed nanoseconds, 0 on error.
+ */
+static uint64_t load(uint32_t chunk, bool baseline)
+{
+  uint32_t size;
+  uint32_t offset = 0;
+  uint32_t len;
+  uint32_t n;
+  bool     ok;
+  uint64_t start = wdTestNs();
+
+  loadChunks = 0;
+  loadSize   = 0;
+  if (baseline)
+    ok = baselineSize(&size);
+  else
+    ok = host_platform_resource_size(WWD_RESOURCE_WLAN_FIRMWARE, &size) == WWD_SUCCESS;
+
+  if (!ok || size > sizeof(loaded))
+    return 0;
+
+  while (offset < size) {
+
+    len = (size - offset < chunk) ? size - offset : chunk;
+    if (baseline)
+      ok = baselineRead(offset, loaded + offset, len, &n);
+    else
+      ok = host_platform_resource_read_indirect(WWD_RESOURCE_WLAN_FIRMWARE,
+                                                offset,
+                                                loaded + offset,
+                                                len,
+                                                &n) == WWD_SUCCESS;
+    if (!ok || n == 0)
+      return 0;
+
+    ++loadChunks;
+    offset += n;
+  }
+
+  loadSize = size;
+
+  return wdTestNs() - start;
+}
+
+/*
+ * Read system calls made by process so far, -1 if not known.
+ */
+static long readSyscalls(void)
+{
+  char  line[64];
+  long  syscr = -1;
+  FILE* f = fopen("/proc/self/io", "r");
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL)
+    if (sscanf(line, "syscr: %ld", &syscr) == 1)
+      break;
+
+  fclose(f);
+  return syscr;
+}
+
+/*
+ * Number of open file descriptors, -1 if not known.
+ */
+static int openFiles(void)
+{
+  DIR* dir = opendir("/proc/self/fd");
+  int  count = 0;
+
+  if (dir == NULL)
+    return -1;
+
+  while (readdir(dir) != NULL)
+    ++count;
+
+  closedir(dir);
+  return count;
+}
+
+/*
+ * Read file into buffer, returns size or -1 on error.
+ */
+static long readFile(const char* name, uint8_t* data, uint32_t max)
+{
+  FILE*  f = fopen(name, "rb");
+  size_t len;
+
+  if (f == NULL)
+    return -1;
+
+  len = fread(data, 1, max, f);
+  if (ferror(f) || fgetc(f) != EOF)
+    len = (size_t)-1;
+
+  fclose(f);
+  return (long)len;
+}
+
+static long copyFile(const char* from, const char* to)
+{
+  static uint8_t data[IMAGE_MAX];
+  long           len = readFile(from, data, sizeof(data));
+
+  if (len < 0 || !writeFile(to, data, len))
+    return -1;
+
+  return len;
+}
+
+/*
+ * Load image with each transfer size and check result.
+ * Returns average nanoseconds per load.
+ */
+static uint64_t timedLoad(uint32_t chunk, bool baseline, long* reads)
+{
+  uint64_t total = 0;
+  uint64_t t;
+  long     before;
+  long     overhead;
+  int      i;
+
+  for (i = 0; i < ROUNDS; i++) {
+
+    memset(loaded, '\0', sizeof(loaded));
+    t = load(chunk, baseline);
+    WD_CHECK(t != 0);
+    WD_CHECK(loadSize == imageSize);
+    WD_CHECK(memcmp(image, loaded, imageSize) == 0);
+    total += t;
+  }
+
+/*
+ * Count reads of one more load. Reading /proc/self/io
+ * itself is a read too, so take that out.
+ */
+  before   = readSyscalls();
+  overhead = readSyscalls() - before;
+  before   = readSyscalls();
+  WD_CHECK(load(chunk, baseline) != 0);
+  *reads = (before < 0) ? -1 : readSyscalls() - before - overhead;
+  return total / ROUNDS;
+}
+
+static void run(const char* metricPrefix, bool throughput)
+{
+  static const uint32_t chunks[] = { 64, 512, 2048 };
+  char                  metric[32];
+  uint64_t              t;
+  uint64_t              baseT;
+  uint32_t              n;
+  long                  reads;
+  long                  baseReads;
+  unsigned int          c;
+
+  for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+
+    t = timedLoad(chunks[c], false, &reads);
+    n = loadChunks;
+
+    snprintf(metric, sizeof(metric), "%s_%lu", metricPrefix, (unsigned long)chunks[c]);
+    if (throughput) {
+
+      wdTestResult("firmware_load", metric, (double)imageSize * 1000.0 / t, "MB/s");
+      continue;
+    }
+
+    baselineSyscalls = 0;
+    baseT = timedLoad(chunks[c], true, &baseReads);
+    WD_CHECK(loadChunks == n);
+
+    wdTestResult("firmware_load", metric, t / 1000.0, "us");
+    snprintf(metric, sizeof(metric), "baseline_%s_%lu", metricPrefix, (unsigned long)chunks[c]);
+    wdTestResult("firmware_load", metric, baseT / 1000.0, "us");
+
+    snprintf(metric, sizeof(metric), "chunks_%lu", (unsigned long)chunks[c]);
+    wdTestResult("firmware_load", metric, n, "count");
+    snprintf(metric, sizeof(metric), "baseline_syscalls_%lu", (unsigned long)chunks[c]);
+    wdTestResult("firmware_load", metric, baselineSyscalls / (ROUNDS + 1), "count");
+
+    if (reads >= 0) {
+
+      snprintf(metric, sizeof(metric), "reads_%lu", (unsigned long)chunks[c]);
+      wdTestResult("firmware_load", metric, reads, "count");
+      snprintf(metric, sizeof(metric), "baseline_reads_%lu", (unsigned long)chunks[c]);
+      wdTestResult("firmware_load", metric, baseReads, "count");
+    }
+  }
+}
+
+/*
+ * Download that is aborted in the middle must not
+ * leave firmware file open.
+ */
+static void abortedLoad(void)
+{
+  uint32_t size;
+  uint32_t n;
+  int      before = openFiles();
+
+  if (before < 0)
+    return;
+
+  WD_CHECK(host_platform_resource_size(WWD_RESOURCE_WLAN_FIRMWARE, &size) == WWD_SUCCESS);
+  WD_CHECK(host_platform_resource_read_indirect(WWD_RESOURCE_WLAN_FIRMWARE, 0, loaded, 512, &n) == WWD_SUCCESS);
+  WD_CHECK(openFiles() == before + 1);
+
+/*
+ * New download reuses descriptor...
+ */
+  WD_CHECK(load(512, false) != 0);
+  WD_CHECK(openFiles() == before);
+
+/*
+ * ...and it can be released explicitly.
+ */
+  WD_CHECK(host_platform_resource_size(WWD_RESOURCE_WLAN_FIRMWARE, &size) == WWD_SUCCESS);
+  wdFirmwareRelease();
+  WD_CHECK(openFiles() == before);
+}
+
+/*
+ * Load real firmware as such and packed. Transfer size
+ * is the largest one used above.
+ */
+static void realFirmware(const char* raw, const char* packed)
+{
+  long     rawSize;
+  long     packedSize;
+  uint64_t rawT;
+  uint64_t packedT;
+  long     reads;
+
+  rawSize = readFile(raw, image, sizeof(image));
+  if (rawSize <= 0)
+    wdTestSkip("real firmware image not available");
+
+  imageSize = rawSize;
+  firmwarePath[0] = ".";
+
+  WD_CHECK(copyFile(raw, WDCFG_FIRMWARE) == rawSize);
+  rawT = timedLoad(2048, false, &reads);
+
+  packedSize = copyFile(packed, WDCFG_FIRMWARE);
+  WD_CHECK(packedSize > 0);
+  packedT = timedLoad(2048, false, &reads);
+
+  wdTestResult("firmware_real", "raw_size", rawSize, "bytes");
+  wdTestResult("firmware_real", "packed_size", packedSize, "bytes");
+  wdTestResult("firmware_real", "load_raw", rawT / 1000.0, "us");
+  wdTestResult("firmware_real", "load_packed", packedT / 1000.0, "us");
+  wdTestResult("firmware_real", "load_diff", ((double)packedT - (double)rawT) / 1000.0, "us");
+
+  remove(WDCFG_FIRMWARE);
+}
+
+void wdTestMain(void)
+{
+  if (wdTestArgc >= 2 && strcmp(wdTestArgv[1], "--real") == 0) {
+
+    if (wdTestArgc != 4)
+      wdTestSkip("real firmware image not given");
+
+    realFirmware(wdTestArgv[2], wdTestArgv[3]);
+    return;
+  }
+
+  makeImage(image, imageSize);
+
+  if (wdTestArgc == 3 && strcmp(wdTestArgv[1], "--write") == 0) {
+
+    WD_CHECK(writeFile(wdTestArgv[2], image, imageSize));
+    return;
+  }
+
+  firmwarePath[0] = ".";
+  WD_CHECK(writeFile(WDCFG_FIRMWARE, image, imageSize));
+
+  run("load", false);
+  abortedLoad();
+
+  if (wdTestArgc == 2) {
+
+    WD_CHECK(copyFile(wdTestArgv[1], WDCFG_FIRMWARE) > 0);
+    run("decompress", true);
+    abortedLoad();
+  }
+
+  remove(WDCFG_FIRMWARE);
+}
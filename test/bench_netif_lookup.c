@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#include "wd_test.h"
+
+#include <string.h>
+
+#include "lwip/tcpip.h"
+#include "network/wwd_buffer_interface.h"
+#include "network/wwd_network_interface.h"
+
+/*
+ * Receive netif lookup. Compares walking netif_list (what
+ * driver used to do for each received frame) with table indexed
+ * by interface, and measures whole receive path per frame.
+ * Driver netif is last in list, behind other netifs.
+ */
+
+#define OTHER_NETIFS 8
+#define LOOKUPS      1000000
+#define FRAMES       20000
+#define FRAME_LEN    128
+#define RX_HEADER    16
+
+static struct netif  others[OTHER_NETIFS];
+static struct netif* table[WWD_ETHERNET_INTERFACE + 1];
+
+static err_t otherInit(struct netif* netif)
+{
+  netif->name[0] = 'o';
+  netif->name[1] = 't';
+  return ERR_OK;
+}
+
+static void addOthers(void* arg)
+{
+  int i;
+
+  for (i = 0; i < OTHER_NETIFS; i++)
+    netif_add(&others[i], NULL, NULL, NULL, (void*)(uintptr_t)(100 + i), otherInit, tcpip_input);
+}
+
+static struct netif* walk(wwd_interface_t interface)
+{
+  struct netif* netif;
+
+  for (netif = netif_list; (netif != NULL) && (netif->state != (void*)interface); netif = netif->next) {
+  }
+
+  return netif;
+}
+
+static struct netif* indexed(wwd_interface_t interface)
+{
+  return ((unsigned int)interface < sizeof(table) / sizeof(table[0])) ? table[interface] : NULL;
+}
+
+static double perCall(struct netif* (*lookup)(wwd_interface_t))
+{
+  volatile uintptr_t sink = 0;
+  uint64_t           start;
+  int                i;
+
+  start = wdTestNs();
+  for (i = 0; i < LOOKUPS; i++)
+    sink += (uintptr_t)lookup(WWD_STA_INTERFACE);
+
+  return (double)(wdTestNs() - start) / LOOKUPS;
+}
+
+void wdTestMain(void)
+{
+  struct netif*  netif = wdTestNetif();
+  wiced_buffer_t buffer;
+  uint8_t*       frame;
+  uint64_t       start;
+  uint64_t       elapsed = 0;
+  int            i;
+
+  wdTestInTcpip(addOthers, NULL);
+  table[WWD_STA_INTERFACE] = netif;
+
+  WD_CHECK(walk(WWD_STA_INTERFACE) == netif);
+  WD_CHECK(indexed(WWD_STA_INTERFACE) == netif);
+
+  wdTestResult("netif_lookup", "list_walk", perCall(walk), "ns");
+  wdTestResult("netif_lookup", "indexed", perCall(indexed), "ns");
+
+/*
+ * Whole receive path. Unknown ethertype makes lwIP
+ * drop frames right after driver has passed them.
+ */
+  for (i = 0; i < FRAMES; i++) {
+
+    if (host_buffer_get(&buffer, WWD_NETWORK_RX, FRAME_LEN + RX_HEADER, WICED_TRUE) != WWD_SUCCESS)
+      break;
+
+/*
+ * Leave room in front like bus layer does.
+ */
+    host_buffer_add_remove_at_front(&buffer, RX_HEADER);
+    frame = host_buffer_get_current_piece_data_pointer(buffer);
+    memcpy(frame, netif->hwaddr, 6);
+    memset(frame + 6, 0x02, 6);
+    frame[12] = 0x88;
+    frame[13] = 0xb5;
+
+    start = wdTestNs();
+    host_network_process_ethernet_data(buffer, WWD_STA_INTERFACE);
+    elapsed += wdTestNs() - start;
+
+/*
+ * Let tcpip thread catch up now and then.
+ */
+    if (i % 16 == 15)
+      nosTaskSleep(1);
+  }
+
+  WD_CHECK(i == FRAMES);
+  wdTestResult("netif_lookup", "rx_path", (double)elapsed / FRAMES, "ns");
+}
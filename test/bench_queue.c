@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#include "wd_test.h"
+
+#include <malloc.h>
+#include <string.h>
+#include <picoos-u.h>
+
+#include "wwd_constants.h"
+#include "RTOS/wwd_rtos_interface.h"
+
+/*
+ * Queue throughput and heap usage, host_rtos queue built on
+ * caller buffer compared with picoos-micro ring that was used
+ * before. Producers run in separate tasks, consumer in test task.
+ * With one producer host_rtos queue runs lock-free, with two
+ * producers producer side locks scheduler. Heap usage is measured
+ * from C library, as nosMemAlloc() uses malloc on unix port.
+ */
+
+#define MESSAGES  20000
+#define SLOTS     8
+#define MAX_SIZE  64
+#define PRODUCERS 2
+
+typedef struct {
+
+  bool (*put)(void* q, const void* msg);
+  bool (*get)(void* q, void* msg);
+  void*  q;
+} Queue;
+
+typedef struct {
+
+  Queue*   queue;
+  uint32_t id;
+  uint32_t count;
+} Producer;
+
+static POSSEMA_t producerDone;
+
+static bool wdPut(void* q, const void* msg)
+{
+  return host_rtos_push_to_queue(q, (void*)msg, NEVER_TIMEOUT) == WWD_SUCCESS;
+}
+
+static bool wdGet(void* q, void* msg)
+{
+  return host_rtos_pop_from_queue(q, msg, NEVER_TIMEOUT) == WWD_SUCCESS;
+}
+
+static bool ringPut(void* q, const void* msg)
+{
+  return uosRingPut(q, (void*)msg, INFINITE);
+}
+
+static bool ringGet(void* q, void* msg)
+{
+  return uosRingGet(q, msg, INFINITE);
+}
+
+static size_t heapUsed(void)
+{
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#else
+  return mallinfo().uordblks;
+#endif
+}
+
+/*
+ * Message starts with producer id (high byte)
+ * and sequence number.
+ */
+static void producer(void* arg)
+{
+  Producer* p = (Producer*)arg;
+  uint8_t   msg[MAX_SIZE];
+  uint32_t  i;
+  uint32_t  seq;
+
+  memset(msg, '\0', sizeof(msg));
+  for (i = 0; i < p->count; i++) {
+
+    seq = (p->id << 24) | i;
+    memcpy(msg, &seq, sizeof(seq));
+    p->queue->put(p->queue->q, msg);
+  }
+
+  nosSemaSignal(producerDone);
+}
+
+/*
+ * Returns messages per second, checking that messages
+ * of each producer arrive in order.
+ */
+static double run(Queue* queue, int producers)
+{
+  Producer p[PRODUCERS];
+  uint32_t next[PRODUCERS];
+  uint8_t  msg[MAX_SIZE];
+  uint32_t i;
+  uint32_t seq;
+  uint64_t start = wdTestNs();
+  bool     inOrder = true;
+  int      n;
+
+  for (n = 0; n < producers; n++) {
+
+    p[n].queue = queue;
+    p[n].id    = n;
+    p[n].count = MESSAGES / producers;
+    next[n]    = 0;
+    nosTaskCreate(producer, &p[n], WD_TEST_PRIORITY, 0, "producer");
+  }
+
+  for (i = 0; i < MESSAGES; i++) {
+
+    WD_CHECK(queue->get(queue->q, msg));
+    memcpy(&seq, msg, sizeof(seq));
+    n = seq >> 24;
+    inOrder = inOrder && n < producers && (seq & 0xffffff) == next[n];
+    if (n < producers)
+      ++next[n];
+  }
+
+  WD_CHECK(inOrder);
+  for (n = 0; n < producers; n++)
+    nosSemaWait(producerDone, INFINITE);
+
+  return MESSAGES * 1e9 / (wdTestNs() - start);
+}
+
+void wdTestMain(void)
+{
+  static const int  sizes[] = { 4, 16, 64 };
+  static uint8_t    buffer[SLOTS * MAX_SIZE];
+  host_queue_type_t wdQueue;
+  WdQueueStats      st;
+  UosRing*          ring;
+  Queue             queue;
+  char              metric[32];
+  size_t            heap;
+  unsigned int      i;
+  int               producers;
+
+  producerDone = nosSemaCreate(0, 0, "done");
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+
+    for (producers = 1; producers <= PRODUCERS; producers++) {
+
+      heap = heapUsed();
+      WD_CHECK(host_rtos_init_queue(&wdQueue, buffer, SLOTS * sizes[i], sizes[i]) == WWD_SUCCESS);
+      heap = heapUsed() - heap;
+
+      queue.put  = wdPut;
+      queue.get  = wdGet;
+      queue.q    = &wdQueue;
+
+      snprintf(metric, sizeof(metric), "host_rtos_%dp_%d", producers, sizes[i]);
+      wdTestResult("queue", metric, run(&queue, producers), "msg/s");
+
+      WD_CHECK(wdGetQueueStats(&st, 1) == 1);
+      WD_CHECK((st.lockFree != 0) == (producers == 1));
+
+      snprintf(metric, sizeof(metric), "host_rtos_heap_%d", sizes[i]);
+      if (producers == 1) {
+
+        wdTestResult("queue", metric, heap, "bytes");
+        snprintf(metric, sizeof(metric), "host_rtos_buffer_%d", sizes[i]);
+        wdTestResult("queue", metric, SLOTS * sizes[i], "bytes");
+      }
+
+      host_rtos_deinit_queue(&wdQueue);
+
+      heap = heapUsed();
+      ring = uosRingCreate(sizes[i], SLOTS);
+      heap = heapUsed() - heap;
+      WD_CHECK(ring != NULL);
+
+      queue.put  = ringPut;
+      queue.get  = ringGet;
+      queue.q    = ring;
+
+      snprintf(metric, sizeof(metric), "uosring_%dp_%d", producers, sizes[i]);
+      wdTestResult("queue", metric, run(&queue, producers), "msg/s");
+
+      if (producers == 1) {
+
+        snprintf(metric, sizeof(metric), "uosring_heap_%d", sizes[i]);
+        wdTestResult("queue", metric, heap, "bytes");
+      }
+
+      uosRingDestroy(ring);
+    }
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include "wd_test.h"
+#include "wd_cycles.h"
+
+/*
+ * Runner for host_rtos microbenchmarks (glue/rtos_bench.c)
+ * on host port. Number of rounds can be given as argument.
+ * Cycle counts are also printed as nanoseconds, so that
+ * results from different targets can be compared.
+ */
+
+#define ROUNDS 10000
+
+static void result(const char* metric, uint32_t cycles)
+{
+  char name[40];
+
+  wdTestResult("rtos", metric, cycles, "cycles");
+  snprintf(name, sizeof(name), "%s_ns", metric);
+  wdTestResult("rtos", name, (double)cycles * 1e9 / WD_CYCLES_PER_SEC, "ns");
+}
+
+void wdTestMain(void)
+{
+  WdRtosBench r;
+  char        name[40];
+  int         rounds = ROUNDS;
+  int         i;
+
+#if !WDCFG_RTOS_BENCH
+  wdTestSkip("WDCFG_RTOS_BENCH not enabled");
+#endif
+
+  if (wdTestArgc > 1)
+    rounds = atoi(wdTestArgv[1]);
+
+  WD_CHECK(wdRtosBenchmark(&r, rounds) == 0);
+
+  result("sema_round_trip", r.semaRoundTrip);
+  for (i = 0; i < WD_BENCH_QUEUE_SIZES; i++) {
+
+    snprintf(name, sizeof(name), "queue_%u", (unsigned)r.queueSizes[i]);
+    result(name, r.queueCycles[i]);
+  }
+
+  result("get_time", r.timeCycles);
+  wdTestResult("rtos", "time_step", r.timeStep, "ms");
+  wdTestResult("rtos", "delay_1ms", r.delayUs, "us");
+
+  WD_CHECK(r.semaRoundTrip > 0);
+  WD_CHECK(r.timeStep >= 1);
+  WD_CHECK(r.delayUs >= 1000);
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include "wd_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/prot/ethernet.h"
+#include "network/wwd_buffer_interface.h"
+#include "network/wwd_network_interface.h"
+
+/*
+ * Receive filter cost. Frames from a pcap capture (Ethernet
+ * link type) are replayed through receive path as if WWD
+ * thread had received them, and time spent for dropped and
+ * passed frames is measured separately. Without argument
+ * a built-in broadcast storm mix is used. With --write file
+ * argument program only writes that mix as pcap file.
+ */
+
+#define MAX_FRAMES 4096
+#define MAX_LEN    1514
+#define ROUNDS     20
+#define RX_HEADER  16
+
+#define PCAP_MAGIC    0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define LINKTYPE_ETH  1
+
+typedef struct {
+
+  uint16_t len;
+  uint8_t  data[MAX_LEN];
+} Frame;
+
+static Frame frames[MAX_FRAMES];
+static int   frameCount;
+
+static const uint8_t broadcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+static const uint8_t lldp[]      = { 0x01, 0x80, 0xc2, 0x00, 0x00, 0x0e };
+static const uint8_t ssdp[]      = { 0x01, 0x00, 0x5e, 0x7f, 0xff, 0xfa };
+static const uint8_t mdns6[]     = { 0x33, 0x33, 0x00, 0x00, 0x00, 0xfb };
+static const uint8_t us[]        = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+
+static void addFrame(const uint8_t* dst, uint16_t type, uint16_t len)
+{
+  Frame* f = &frames[frameCount++];
+
+  memset(f->data, '\0', len);
+  memcpy(f->data, dst, 6);
+  f->data[6]  = 0x02;
+  f->data[11] = frameCount & 0xff;
+  f->data[12] = type >> 8;
+  f->data[13] = type & 0xff;
+  f->len = len;
+}
+
+/*
+ * Broadcast storm: mostly broadcast and multicast
+ * that host doesn't want, some ARP and unicast.
+ */
+static void makeStorm(void)
+{
+  int i;
+
+  for (i = 0; i < 100; i++) {
+
+    addFrame(broadcast, ETHTYPE_IP, 342);  // DHCP/NetBIOS style broadcast
+    addFrame(broadcast, ETHTYPE_IP, 92);
+    addFrame(broadcast, ETHTYPE_IP, 243);
+    addFrame(broadcast, ETHTYPE_ARP, 60);
+    addFrame(broadcast, ETHTYPE_ARP, 60);
+    addFrame(lldp, 0x88cc, 120);
+    addFrame(lldp, 0x88cc, 120);
+    addFrame(ssdp, ETHTYPE_IP, 400);
+    addFrame(mdns6, ETHTYPE_IPV6, 180);
+    addFrame(us, ETHTYPE_IP, 98);
+  }
+}
+
+static uint32_t swap32(uint32_t v, bool swap)
+{
+  return swap ? __builtin_bswap32(v) : v;
+}
+
+static bool writePcap(const char* name)
+{
+  uint32_t hdr[6] = { PCAP_MAGIC, 0x00040002, 0, 0, MAX_LEN, LINKTYPE_ETH };
+  uint32_t rec[4];
+  FILE*    f = fopen(name, "wb");
+  int      i;
+
+  if (f == NULL)
+    return false;
+
+  fwrite(hdr, sizeof(hdr), 1, f);
+  for (i = 0; i < frameCount; i++) {
+
+    rec[0] = i / 1000;
+    rec[1] = (i % 1000) * 1000;
+    rec[2] = frames[i].len;
+    rec[3] = frames[i].len;
+    fwrite(rec, sizeof(rec), 1, f);
+    fwrite(frames[i].data, frames[i].len, 1, f);
+  }
+
+  return fclose(f) == 0;
+}
+
+/*
+ * Read pcap file in either byte order. Frames longer
+ * than MAX_LEN are skipped.
+ */
+static bool readPcap(const char* name)
+{
+  uint32_t hdr[6];
+  uint32_t rec[4];
+  uint32_t len;
+  bool     swap;
+  FILE*    f = fopen(name, "rb");
+
+  if (f == NULL || fread(hdr, sizeof(hdr), 1, f) != 1)
+    return false;
+
+  if (hdr[0] == PCAP_MAGIC || hdr[0] == PCAP_MAGIC_NS)
+    swap = false;
+  else if (swap32(hdr[0], true) == PCAP_MAGIC || swap32(hdr[0], true) == PCAP_MAGIC_NS)
+    swap = true;
+  else
+    return false;
+
+  if (swap32(hdr[5], swap) != LINKTYPE_ETH)
+    return false;
+
+  while (frameCount < MAX_FRAMES && fread(rec, sizeof(rec), 1, f) == 1) {
+
+    len = swap32(rec[2], swap);
+    if (len > MAX_LEN || len < SIZEOF_ETH_HDR) {
+
+      fseek(f, len, SEEK_CUR);
+      continue;
+    }
+
+    frames[frameCount].len = len;
+    if (fread(frames[frameCount].data, len, 1, f) != 1)
+      break;
+
+    ++frameCount;
+  }
+
+  fclose(f);
+  return frameCount > 0;
+}
+
+static uint32_t dropped(void)
+{
+  WdRxFilterStats st;
+  uint32_t        n;
+  int             i;
+
+  wdGetRxFilterStats(&st);
+  n = st.etherTypeDropped + st.runts;
+  for (i = 0; i < WD_RX_CLASS_COUNT; i++)
+    n += st.classDropped[i];
+
+  return n;
+}
+
+void wdTestMain(void)
+{
+  static const uint16_t types[] = { ETHTYPE_IP, ETHTYPE_ARP, ETHTYPE_IPV6, 0x888e };
+
+  wiced_buffer_t buffer;
+  WdHistogram    hist;
+  uint64_t       dropNs = 0;
+  uint64_t       passNs = 0;
+  uint32_t       drops  = 0;
+  uint32_t       passes = 0;
+  uint32_t       before;
+  uint64_t       start;
+  uint64_t       elapsed;
+  int            round;
+  int            i;
+
+#if !WDCFG_RX_FILTER
+  wdTestSkip("WDCFG_RX_FILTER not enabled");
+#endif
+
+  if (wdTestArgc == 3 && strcmp(wdTestArgv[1], "--write") == 0) {
+
+    makeStorm();
+    WD_CHECK(writePcap(wdTestArgv[2]));
+    return;
+  }
+
+  if (wdTestArgc == 2)
+    WD_CHECK(readPcap(wdTestArgv[1]));
+  else
+    makeStorm();
+
+  if (frameCount == 0)
+    return;
+
+  wdTestNetif();
+
+/*
+ * Typical configuration for a device that needs
+ * only IP: other broadcast and multicast is dropped, mDNS
+ * style IPv4 multicast is rate limited.
+ */
+  wdRxFilterSetEtherTypes(types, sizeof(types) / sizeof(types[0]));
+  wdRxFilterSetRate(WD_RX_BROADCAST, 0, 0);
+  wdRxFilterSetRate(WD_RX_MULTICAST, 0, 0);
+  wdRxFilterSetRate(WD_RX_MULTICAST_IPV4, 20, 5);
+  wdResetHistograms();
+
+  for (round = 0; round < ROUNDS; round++) {
+
+    for (i = 0; i < frameCount; i++) {
+
+      if (host_buffer_get(&buffer, WWD_NETWORK_RX, frames[i].len + RX_HEADER, WICED_TRUE) != WWD_SUCCESS)
+        break;
+
+      host_buffer_add_remove_at_front(&buffer, RX_HEADER);
+      memcpy(host_buffer_get_current_piece_data_pointer(buffer), frames[i].data, frames[i].len);
+
+      before  = dropped();
+      start   = wdTestNs();
+      host_network_process_ethernet_data(buffer, WWD_STA_INTERFACE);
+      elapsed = wdTestNs() - start;
+
+      if (dropped() != before) {
+
+        dropNs += elapsed;
+        ++drops;
+      }
+      else {
+
+        passNs += elapsed;
+        ++passes;
+      }
+
+/*
+ * Let tcpip thread process passed frames.
+ */
+      if (i % 16 == 15)
+        nosTaskSleep(1);
+    }
+  }
+
+  WD_CHECK(drops > 0);
+  wdTestResult("rx_filter", "frames", drops + passes, "frames");
+  wdTestResult("rx_filter", "dropped", 100.0 * drops / (drops + passes), "%");
+  if (drops > 0)
+    wdTestResult("rx_filter", "drop_ns", (double)dropNs / drops, "ns");
+
+  if (passes > 0)
+    wdTestResult("rx_filter", "pass_ns", (double)passNs / passes, "ns");
+
+/*
+ * Histogram covers whole drop path, cycles are
+ * nanoseconds on host.
+ */
+  wdGetHistogram(WD_HIST_RX_DROP, &hist);
+  WD_CHECK(hist.count >= drops);
+  if (hist.count > 0)
+    wdTestResult("rx_filter", "drop_cycles", (double)hist.total / hist.count, "cycles");
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd_test.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/tcp.h"
+#include "lwip/stats.h"
+
+/*
+ * Packet throughput through driver netif path. Simulated bus
+ * loops frames between station and AP netifs, UDP and TCP
+ * flows are run from station to AP with different frame
+ * sizes. For each run packets/s, bytes/s and cycles per packet
+ * are reported for TX and RX separately, together with
+ * peak pbuf pool usage. Run time in ms can be given as argument.
+ *
+ * Flows are self-clocked in tcpip thread: UDP sender keeps
+ * WINDOW datagrams in flight, TCP sender fills send buffer
+ * when data is acknowledged.
+ */
+
+#define UDP_PORT  5001
+#define TCP_PORT  5002
+#define WINDOW    16
+#define RUN_MS    1000
+
+/*
+ * Ethernet frame sizes without FCS.
+ */
+static const uint16_t frameSizes[] = { 64, 128, 256, 512, 1024, 1514 };
+
+typedef struct {
+
+  uint16_t        payload;
+  volatile bool   running;
+  uint32_t        sent;
+  uint32_t        received;
+  uint32_t        lost;
+  uint32_t        lastReceived;
+  uint64_t        bytes;
+  struct udp_pcb* udpTx;
+  struct udp_pcb* udpRx;
+  struct tcp_pcb* tcpTx;
+  struct tcp_pcb* tcpRx;
+} Flow;
+
+static Flow            flow;
+static struct tcp_pcb* tcpListen;
+static uint8_t         payloadBuf[1514];
+
+/*
+ * UDP flow.
+ */
+static void udpSend(void)
+{
+  struct pbuf* p;
+  ip4_addr_t   dst;
+
+  IP4_ADDR(&dst, 192, 168, 99, 1);
+  while (flow.running && flow.sent - flow.received - flow.lost < WINDOW) {
+
+    p = pbuf_alloc(PBUF_TRANSPORT, flow.payload, PBUF_POOL);
+    if (p == NULL)
+      return;
+
+    pbuf_take(p, payloadBuf, flow.payload);
+    if (udp_sendto(flow.udpTx, p, &dst, UDP_PORT) == ERR_OK)
+      ++flow.sent;
+
+    pbuf_free(p);
+  }
+}
+
+static void udpRecv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+  ++flow.received;
+  flow.bytes += p->tot_len;
+  pbuf_free(p);
+  udpSend();
+}
+
+static void udpStart(void* arg)
+{
+  flow.udpRx = udp_new();
+  flow.udpTx = udp_new();
+  LWIP_ASSERT("udp pcbs", flow.udpRx != NULL && flow.udpTx != NULL);
+
+  udp_bind_netif(flow.udpRx, wdTestApNetif());
+  udp_bind(flow.udpRx, IP4_ADDR_ANY, UDP_PORT);
+  udp_recv(flow.udpRx, udpRecv, NULL);
+
+  udp_bind_netif(flow.udpTx, wdTestNetif());
+  udpSend();
+}
+
+/*
+ * Datagrams lost on the way would stop the flow,
+ * account them as lost if no progress was made.
+ */
+static void udpPoll(void* arg)
+{
+  if (flow.received == flow.lastReceived) {
+
+    flow.lost = flow.sent - flow.received;
+    udpSend();
+  }
+
+  flow.lastReceived = flow.received;
+}
+
+static void udpStop(void* arg)
+{
+  flow.running = false;
+  udp_remove(flow.udpTx);
+  udp_remove(flow.udpRx);
+}
+
+/*
+ * TCP flow. Segment size is forced by setting
+ * MSS of sending pcb.
+ */
+static void tcpFill(void)
+{
+  while (flow.running && tcp_sndbuf(flow.tcpTx) >= flow.payload) {
+
+    if (tcp_write(flow.tcpTx, payloadBuf, flow.payload, TCP_WRITE_FLAG_COPY) != ERR_OK)
+      break;
+
+    ++flow.sent;
+  }
+
+  tcp_output(flow.tcpTx);
+}
+
+static err_t tcpSent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+  tcpFill();
+  return ERR_OK;
+}
+
+static err_t tcpRecv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+  if (p == NULL)
+    return ERR_OK;
+
+  ++flow.received;
+  flow.bytes += p->tot_len;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static err_t tcpAccept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+  if (err != ERR_OK || pcb == NULL)
+    return ERR_VAL;
+
+  flow.tcpRx = pcb;
+  tcp_recv(pcb, tcpRecv);
+  return ERR_OK;
+}
+
+static err_t tcpConnected(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+  tcp_nagle_disable(pcb);
+  pcb->mss = LWIP_MIN(flow.payload, TCP_MSS);
+  tcpFill();
+  return ERR_OK;
+}
+
+static void tcpStart(void* arg)
+{
+  ip4_addr_t dst;
+
+  if (tcpListen == NULL) {
+
+    tcpListen = tcp_new();
+    LWIP_ASSERT("tcp pcb", tcpListen != NULL);
+
+    tcp_bind_netif(tcpListen, wdTestApNetif());
+    tcp_bind(tcpListen, IP4_ADDR_ANY, TCP_PORT);
+    tcpListen = tcp_listen(tcpListen);
+    tcp_accept(tcpListen, tcpAccept);
+  }
+
+  flow.tcpTx = tcp_new();
+  LWIP_ASSERT("tcp pcb", flow.tcpTx != NULL);
+
+  IP4_ADDR(&dst, 192, 168, 99, 1);
+  tcp_bind_netif(flow.tcpTx, wdTestNetif());
+  tcp_sent(flow.tcpTx, tcpSent);
+  tcp_connect(flow.tcpTx, &dst, TCP_PORT, tcpConnected);
+}
+
+static void tcpStop(void* arg)
+{
+  flow.running = false;
+  if (flow.tcpRx != NULL)
+    tcp_abort(flow.tcpRx);
+
+  tcp_abort(flow.tcpTx);
+}
+
+#if MEMP_STATS
+static void poolReset(void* arg)
+{
+  lwip_stats.memp[MEMP_PBUF_POOL]->max = lwip_stats.memp[MEMP_PBUF_POOL]->used;
+}
+#endif
+
+static void report(const char* proto, uint16_t size, uint64_t ns,
+                   const WdTrafficStats* a, const WdTrafficStats* b)
+{
+  char     metric[40];
+  double   sec  = ns / 1e9;
+  uint32_t txFrames = b->txFrames - a->txFrames;
+  uint32_t rxFrames = b->rxFrames - a->rxFrames;
+
+#define RESULT(name, value, unit) \
+  do { snprintf(metric, sizeof(metric), "%s_%u_%s", proto, size, name); \
+       wdTestResult("traffic", metric, value, unit); } while (0)
+
+  RESULT("tx_pps", txFrames / sec, "pps");
+  RESULT("tx_bytes", (b->txBytes - a->txBytes) / sec, "B/s");
+  RESULT("tx_cycles", txFrames ? (double)(b->txCycles - a->txCycles) / txFrames : 0, "cycles");
+  RESULT("rx_pps", rxFrames / sec, "pps");
+  RESULT("rx_bytes", (b->rxBytes - a->rxBytes) / sec, "B/s");
+  RESULT("rx_cycles", rxFrames ? (double)(b->rxCycles - a->rxCycles) / rxFrames : 0, "cycles");
+  RESULT("goodput", flow.bytes / sec, "B/s");
+#if MEMP_STATS
+  RESULT("pool_max", lwip_stats.memp[MEMP_PBUF_POOL]->max, "pbufs");
+#endif
+
+#undef RESULT
+}
+
+/*
+ * Run one flow for given time, polling it every 50 ms.
+ * Headers are subtracted from frame size to get payload.
+ */
+static void run(const char* proto, uint16_t size, uint16_t headers, uint32_t ms,
+                void (*start)(void*), void (*poll)(void*), void (*stop)(void*))
+{
+  WdTrafficStats a;
+  WdTrafficStats b;
+  uint64_t       t0;
+  uint32_t       left;
+
+  memset(&flow, '\0', sizeof(flow));
+  flow.running = true;
+  flow.payload = size - headers;
+
+#if MEMP_STATS
+  wdTestInTcpip(poolReset, NULL);
+#endif
+
+  wdGetTrafficStats(&a);
+  t0 = wdTestNs();
+  wdTestInTcpip(start, NULL);
+
+  for (left = ms; left > 0; left -= LWIP_MIN(left, 50)) {
+
+    nosTaskSleep(MS(LWIP_MIN(left, 50)));
+    if (poll != NULL)
+      wdTestInTcpip(poll, NULL);
+  }
+
+  wdTestInTcpip(stop, NULL);
+  wdGetTrafficStats(&b);
+
+  WD_CHECK(flow.received > 0);
+  report(proto, size, wdTestNs() - t0, &a, &b);
+}
+
+void wdTestMain(void)
+{
+  WdSimStats st;
+  uint32_t   ms = RUN_MS;
+  uint32_t   i;
+
+#if !LWIP_UDP || !LWIP_TCP
+  wdTestSkip("UDP and TCP needed");
+#endif
+
+  if (wdTestArgc > 1)
+    ms = atoi(wdTestArgv[1]);
+
+  wdTestApNetif();
+  wdSimSetLoopback(true);
+
+/*
+ * Let ARP resolve both ways before measuring.
+ */
+  flow.payload = 64;
+  flow.running = true;
+  wdTestInTcpip(udpStart, NULL);
+  nosTaskSleep(MS(100));
+  wdTestInTcpip(udpStop, NULL);
+
+  for (i = 0; i < sizeof(frameSizes) / sizeof(frameSizes[0]); i++)
+    run("udp", frameSizes[i], 14 + 20 + 8, ms, udpStart, udpPoll, udpStop);
+
+  for (i = 0; i < sizeof(frameSizes) / sizeof(frameSizes[0]); i++)
+    run("tcp", frameSizes[i], 14 + 20 + 20, ms, tcpStart, NULL, tcpStop);
+
+  wdGetSimStats(&st);
+  wdTestResult("traffic", "bus_drops", st.busDrops, "frames");
+}
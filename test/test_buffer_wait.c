@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#include "wd_test.h"
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "network/wwd_buffer_interface.h"
+
+/*
+ * Check that task waiting for an empty PBUF_POOL is woken up
+ * as soon as a buffer is released, instead of on next tick.
+ * Buffers are freed with pbuf_free() by another task, so that
+ * wakeup comes through lwIP hook (wdMempAvailable) and not
+ * from host_buffer_release().
+ */
+
+#define ROUNDS   100
+#define MAX_HELD 256
+
+static wiced_buffer_t          held[MAX_HELD];
+static int                     heldCount;
+static volatile wiced_buffer_t got;
+static volatile uint64_t       releasedAt;
+static uint64_t                latency[ROUNDS];
+static POSSEMA_t               done;
+static POSSEMA_t               release;
+
+static void waiter(void* arg)
+{
+  wiced_buffer_t buffer;
+  int            i;
+
+  for (i = 0; i < ROUNDS; i++) {
+
+    host_buffer_get(&buffer, WWD_NETWORK_RX, 100, WICED_TRUE);
+    latency[i] = wdTestNs() - releasedAt;
+    got = buffer;
+    nosSemaSignal(done);
+  }
+}
+
+static void freer(void* arg)
+{
+  while (1) {
+
+    nosSemaWait(release, INFINITE);
+    releasedAt = wdTestNs();
+    pbuf_free(held[--heldCount]);
+  }
+}
+
+void wdTestMain(void)
+{
+  wiced_buffer_t buffer;
+  uint64_t       total = 0;
+  uint64_t       max   = 0;
+  uint64_t       tick  = 1000000000ULL / HZ;
+  int            i;
+
+#ifndef LWIP_HOOK_MEMP_AVAILABLE
+  wdTestSkip("LWIP_HOOK_MEMP_AVAILABLE not set in lwipopts.h");
+#endif
+
+  wdTestNetif();
+  done    = nosSemaCreate(0, 0, "done");
+  release = nosSemaCreate(0, 0, "release");
+
+/*
+ * Empty the pool.
+ */
+  while (heldCount < MAX_HELD &&
+         host_buffer_get(&buffer, WWD_NETWORK_RX, 100, WICED_FALSE) == WWD_SUCCESS)
+    held[heldCount++] = buffer;
+
+  WD_CHECK(heldCount > 0 && heldCount < MAX_HELD);
+
+  nosTaskCreate(waiter, NULL, WD_TEST_PRIORITY + 1, 0, "waiter");
+  nosTaskCreate(freer, NULL, WD_TEST_PRIORITY, 0, "freer");
+
+  for (i = 0; i < ROUNDS; i++) {
+
+/*
+ * Let waiter block, then have freer give it one buffer.
+ */
+    nosTaskSleep(MS(2));
+    nosSemaSignal(release);
+
+    nosSemaWait(done, INFINITE);
+    held[heldCount++] = got;
+  }
+
+  for (i = 0; i < ROUNDS; i++) {
+
+    total += latency[i];
+    if (latency[i] > max)
+      max = latency[i];
+  }
+
+  wdTestResult("buffer_wait", "wake_avg", total / ROUNDS, "ns");
+  wdTestResult("buffer_wait", "wake_max", max, "ns");
+
+/*
+ * Polling would give about half a tick on average.
+ */
+  WD_CHECK(total / ROUNDS < tick / 4);
+
+  while (heldCount > 0)
+    host_buffer_release(held[--heldCount], WWD_NETWORK_RX);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include "wd_test.h"
+
+/*
+ * Monotonic clock (glue/clock.c). Checks that time follows
+ * host clock when cycle counter wraps between reads and when
+ * it is stopped like in MCU sleep, and that it never goes
+ * backwards. Host cycle counter is in nanoseconds, so it
+ * wraps in about 4.3 seconds.
+ */
+
+#define TICK_US  (1000000 / HZ)
+#define SLACK_US 200
+
+/*
+ * Time within a tick comes from tick timer, so interval may
+ * be off by about one tick (signal delivery of host port tick
+ * can be late). Slack covers reading both clocks.
+ */
+static void checkInterval(const char* name, uint64_t us, uint64_t hostNs, uint64_t slack)
+{
+  int64_t err = (int64_t)us - (int64_t)(hostNs / 1000);
+  int64_t max = TICK_US + SLACK_US + slack;
+
+  wdTestResult("clock", name, (double)err, "us");
+  WD_CHECK(err < max && err > -max);
+}
+
+static void monotonic(uint32_t ms)
+{
+  uint64_t end = wdTestNs() + (uint64_t)ms * 1000000;
+  uint64_t prev = wdTimeUs();
+  uint64_t now;
+
+  while (wdTestNs() < end) {
+
+    now = wdTimeUs();
+    WD_CHECK(now >= prev);
+    prev = now;
+  }
+}
+
+void wdTestMain(void)
+{
+  uint64_t us;
+  uint64_t ns;
+  uint32_t ms;
+
+/*
+ * Clock follows host time while read often.
+ */
+  us = wdTimeUs();
+  ns = wdTestNs();
+  monotonic(200);
+  checkInterval("run_error", wdTimeUs() - us, wdTestNs() - ns, 0);
+
+/*
+ * Counter wraps while clock is not read.
+ */
+  us = wdTimeUs();
+  ns = wdTestNs();
+  nosTaskSleep(MS(4500));
+  checkInterval("wrap_error", wdTimeUs() - us, wdTestNs() - ns, 0);
+
+/*
+ * Counter stops during sleep. Clock keeps
+ * following jiffies while it is stopped.
+ */
+  us = wdTimeUs();
+  ms = wdTimeMs();
+  ns = wdTestNs();
+  wdSimStopCycles(true);
+  nosTaskSleep(MS(300));
+  checkInterval("stopped_error", wdTimeUs() - us, wdTestNs() - ns, 0);
+  monotonic(50);
+  nosTaskSleep(MS(200));
+  wdSimStopCycles(false);
+  monotonic(50);
+  checkInterval("sleep_error", wdTimeUs() - us, wdTestNs() - ns, 0);
+
+/*
+ * Milliseconds are truncated at both ends.
+ */
+  checkInterval("sleep_error_ms", (uint64_t)(wdTimeMs() - ms) * 1000, wdTestNs() - ns, 1000);
+}
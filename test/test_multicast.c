@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "wd_test.h"
+#include "wd_glue.h"
+
+#include "wwd_constants.h"
+#include "wwd_structures.h"
+
+/*
+ * Multicast tables. Checks what simulated firmware gets as
+ * groups join and leave: reference counting, switch to allmulti
+ * and back, per-interface tables and restoring lists after
+ * WWD is reinitialized. Update rejected by firmware must
+ * be retried.
+ */
+
+#ifndef WDCFG_MCAST_HW_MAX
+#define WDCFG_MCAST_HW_MAX 10
+#endif
+
+#define EXTRA (WDCFG_MCAST_HW_MAX + 2)
+
+typedef struct {
+
+  wwd_interface_t interface;
+  uint8_t         mac[6];
+  int             count;
+  bool            join;
+} Op;
+
+typedef struct {
+
+  uint32_t    count;
+  wiced_mac_t macs[WDCFG_MCAST_HW_MAX];
+} List;
+
+static void groupMac(uint8_t* mac, int n)
+{
+  mac[0] = 0x01;
+  mac[1] = 0x00;
+  mac[2] = 0x5e;
+  mac[3] = 0x10;
+  mac[4] = n >> 8;
+  mac[5] = n & 0xff;
+}
+
+/*
+ * Join or leave groups with consecutive MACs in tcpip
+ * thread, like IGMP and MLD would.
+ */
+static void doOp(void* arg)
+{
+  Op*     op = (Op*)arg;
+  uint8_t mac[6];
+  int     i;
+
+  for (i = 0; i < op->count; i++) {
+
+    memcpy(mac, op->mac, 6);
+    mac[5] += i;
+    if (op->join)
+      WD_CHECK(wdMulticastJoin(op->interface, mac) == ERR_OK);
+    else
+      WD_CHECK(wdMulticastLeave(op->interface, mac) == ERR_OK);
+  }
+}
+
+static void run(wwd_interface_t interface, int group, int count, bool join)
+{
+  Op op;
+
+  op.interface = interface;
+  op.count     = count;
+  op.join      = join;
+  groupMac(op.mac, group);
+  wdTestInTcpip(doOp, &op);
+
+/*
+ * Let worker task write changes to firmware.
+ */
+  nosTaskSleep(MS(50));
+}
+
+static int list(wwd_interface_t interface, List* l)
+{
+  memset(l, '\0', sizeof(*l));
+  if (wdSimGetIovar("mcast_list", interface, l, sizeof(*l)) < 0)
+    return -1;
+
+  return l->count;
+}
+
+static bool listHas(const List* l, int group)
+{
+  uint8_t  mac[6];
+  uint32_t i;
+
+  groupMac(mac, group);
+  for (i = 0; i < l->count; i++)
+    if (memcmp(l->macs[i].octet, mac, 6) == 0)
+      return true;
+
+  return false;
+}
+
+static int allMulti(wwd_interface_t interface)
+{
+  uint32_t on = 0;
+
+  wdSimGetIovar("allmulti", interface, &on, sizeof(on));
+  return on;
+}
+
+void wdTestMain(void)
+{
+  WdMulticastStats before;
+  WdMulticastStats after;
+  List             l;
+  uint8_t          mac[6];
+
+  wdTestNetif();
+
+/*
+ * Two groups mapping to same MAC.
+ */
+  run(WWD_AP_INTERFACE, 1, 1, true);
+  run(WWD_AP_INTERFACE, 1, 1, true);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 1 && listHas(&l, 1));
+
+  run(WWD_AP_INTERFACE, 1, 1, false);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 1 && listHas(&l, 1));
+
+/*
+ * Station table is separate.
+ */
+  list(WWD_STA_INTERFACE, &l);
+  WD_CHECK(!listHas(&l, 1));
+
+/*
+ * Overflow firmware list, changes made in one go
+ * are written as single update.
+ */
+  wdGetMulticastStats(&before);
+  run(WWD_AP_INTERFACE, 100, EXTRA, true);
+  wdGetMulticastStats(&after);
+
+  WD_CHECK(after.fwUpdates - before.fwUpdates <= 4);
+  WD_CHECK(after.allMulti);
+  WD_CHECK(allMulti(WWD_AP_INTERFACE) == 1);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 0);
+
+  groupMac(mac, 100);
+  WD_CHECK(wdMulticastAccept(WWD_AP_INTERFACE, mac));
+  groupMac(mac, 1);
+  WD_CHECK(wdMulticastAccept(WWD_AP_INTERFACE, mac));
+  groupMac(mac, 50);
+  WD_CHECK(!wdMulticastAccept(WWD_AP_INTERFACE, mac));
+  WD_CHECK(wdMulticastAccept(WWD_STA_INTERFACE, mac));
+  WD_CHECK(allMulti(WWD_STA_INTERFACE) != 1);
+
+/*
+ * Back to firmware list.
+ */
+  run(WWD_AP_INTERFACE, 100, EXTRA, false);
+  WD_CHECK(allMulti(WWD_AP_INTERFACE) == 0);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 1 && listHas(&l, 1));
+  groupMac(mac, 50);
+  WD_CHECK(wdMulticastAccept(WWD_AP_INTERFACE, mac));
+
+  wdGetMulticastStats(&after);
+  WD_CHECK(!after.allMulti);
+
+/*
+ * Restarted firmware gets the list again.
+ */
+  WD_CHECK(wdManagementInit(WICED_COUNTRY_WORLD_WIDE_XX, NULL) == WWD_SUCCESS);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == -1);
+  nosTaskSleep(MS(50));
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 1 && listHas(&l, 1));
+
+  run(WWD_AP_INTERFACE, 1, 1, false);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 0);
+
+  wdGetMulticastStats(&after);
+  WD_CHECK(after.fwErrors == 0);
+
+/*
+ * Firmware rejects two updates. Worker retries after
+ * WDCFG_WORKER_RETRY (default 100 ms), doubling delay.
+ */
+  wdSimFailIovars(2);
+  run(WWD_AP_INTERFACE, 200, 1, true);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 0);
+  nosTaskSleep(MS(500));
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 1 && listHas(&l, 200));
+
+  wdGetMulticastStats(&after);
+  WD_CHECK(after.fwErrors == 2);
+
+  run(WWD_AP_INTERFACE, 200, 1, false);
+  WD_CHECK(list(WWD_AP_INTERFACE, &l) == 0);
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+#include "wd_test.h"
+
+#include "wwd_constants.h"
+#include "RTOS/wwd_rtos_interface.h"
+
+/*
+ * Priority inversion with WWD mutexes. Low priority task holds
+ * a mutex while a medium priority task burns CPU. High priority
+ * task waiting for the mutex must get it after low priority task
+ * has done its (short) work, not after medium one stops. Second
+ * case chains two mutexes, so that inheritance must pass through
+ * a task that is itself waiting. Same cases are run with binary
+ * semaphores (the way WWD serialized IOCTLs before) as baseline.
+ * Each case is repeated and worst wait is reported.
+ */
+
+#define PRIO_LOW    1
+#define PRIO_MID    2
+#define PRIO_SPIN   3
+#define PRIO_HIGH   4
+
+#define HOLD_NS     (20 * 1000000ULL)
+#define SPIN_NS     (400 * 1000000ULL)
+#define MAX_WAIT_NS (150 * 1000000ULL)
+#define REPEAT      5
+
+typedef struct {
+
+  bool                  isMutex;
+  host_mutex_type_t     mutex;
+  host_semaphore_type_t sema;
+} Lock;
+
+static Lock              a;
+static Lock              b;
+static POSSEMA_t         locked;
+static POSSEMA_t         done;
+static volatile uint64_t waitNs;
+static volatile VAR_t    lowAfter;
+
+static void lockInit(Lock* l, bool isMutex)
+{
+  l->isMutex = isMutex;
+  if (isMutex) {
+
+    WD_CHECK(host_rtos_init_mutex(&l->mutex) == WWD_SUCCESS);
+    return;
+  }
+
+/*
+ * Binary semaphore is made available by first set,
+ * like WWD does.
+ */
+  WD_CHECK(host_rtos_init_semaphore(&l->sema) == WWD_SUCCESS);
+  WD_CHECK(host_rtos_set_semaphore(&l->sema, WICED_FALSE) == WWD_SUCCESS);
+}
+
+static void lockDeinit(Lock* l)
+{
+  if (l->isMutex)
+    host_rtos_deinit_mutex(&l->mutex);
+  else
+    host_rtos_deinit_semaphore(&l->sema);
+}
+
+static void lock(Lock* l)
+{
+  if (l->isMutex)
+    WD_CHECK(host_rtos_lock_mutex(&l->mutex) == WWD_SUCCESS);
+  else
+    WD_CHECK(host_rtos_get_semaphore(&l->sema, NEVER_TIMEOUT, WICED_FALSE) == WWD_SUCCESS);
+}
+
+static void unlock(Lock* l)
+{
+  if (l->isMutex)
+    WD_CHECK(host_rtos_unlock_mutex(&l->mutex) == WWD_SUCCESS);
+  else
+    WD_CHECK(host_rtos_set_semaphore(&l->sema, WICED_FALSE) == WWD_SUCCESS);
+}
+
+static void busy(uint64_t ns)
+{
+  uint64_t end = wdTestNs() + ns;
+
+  while (wdTestNs() < end);
+}
+
+static void spinner(void* arg)
+{
+  busy(SPIN_NS);
+  nosSemaSignal(done);
+}
+
+static void low(void* arg)
+{
+  lock(&a);
+  nosSemaSignal(locked);
+  busy(HOLD_NS);
+  unlock(&a);
+  lowAfter = posTaskGetPriority(nosTaskGetCurrent());
+  nosSemaSignal(done);
+}
+
+static void mid(void* arg)
+{
+  lock(&b);
+  nosSemaSignal(locked);
+  lock(&a);
+  unlock(&a);
+  unlock(&b);
+  WD_CHECK(posTaskGetPriority(nosTaskGetCurrent()) == PRIO_MID);
+  nosSemaSignal(done);
+}
+
+static void high(void* arg)
+{
+  Lock*    l = (Lock*)arg;
+  uint64_t start = wdTestNs();
+
+  lock(l);
+  waitNs = wdTestNs() - start;
+  unlock(l);
+  nosSemaSignal(done);
+}
+
+static void waitDone(int count)
+{
+  while (count--)
+    WD_CHECK(nosSemaWait(done, MS(5000)) == 0);
+}
+
+/*
+ * Run case REPEAT times, return worst wait of high
+ * priority task.
+ */
+static uint64_t run(bool chained)
+{
+  uint64_t worst = 0;
+  int      i;
+
+  for (i = 0; i < REPEAT; i++) {
+
+    lowAfter = -1;
+    nosTaskCreate(low, NULL, PRIO_LOW, 4096, "low");
+    WD_CHECK(nosSemaWait(locked, MS(1000)) == 0);
+    if (chained) {
+
+      nosTaskCreate(mid, NULL, PRIO_MID, 4096, "mid");
+      WD_CHECK(nosSemaWait(locked, MS(1000)) == 0);
+    }
+
+    nosTaskCreate(spinner, NULL, PRIO_SPIN, 4096, "spin");
+    nosTaskCreate(high, chained ? &b : &a, PRIO_HIGH, 4096, "high");
+
+    waitDone(chained ? 4 : 3);
+    WD_CHECK(lowAfter == PRIO_LOW);
+    if (waitNs > worst)
+      worst = waitNs;
+  }
+
+  return worst;
+}
+
+static void scenario(const char* name, bool chained)
+{
+  char     metric[40];
+  uint64_t mutexNs;
+  uint64_t semaNs;
+
+  lockInit(&a, true);
+  lockInit(&b, true);
+  mutexNs = run(chained);
+  lockDeinit(&a);
+  lockDeinit(&b);
+
+  lockInit(&a, false);
+  lockInit(&b, false);
+  semaNs = run(chained);
+  lockDeinit(&a);
+  lockDeinit(&b);
+
+  snprintf(metric, sizeof(metric), "%s_worst_ms", name);
+  wdTestResult("mutex_inversion", metric, mutexNs / 1000000.0, "ms");
+  snprintf(metric, sizeof(metric), "sema_%s_worst_ms", name);
+  wdTestResult("mutex_inversion", metric, semaNs / 1000000.0, "ms");
+
+  WD_CHECK(mutexNs < MAX_WAIT_NS);
+}
+
+void wdTestMain(void)
+{
+#if !POSCFG_FEATURE_GETPRIORITY || !POSCFG_FEATURE_SETPRIORITY
+  wdTestSkip("no task priority get/set");
+#else
+  if (POSCFG_MAX_PRIO_LEVEL <= PRIO_HIGH + 1)
+    wdTestSkip("not enough priority levels");
+
+  posTaskSetPriority(nosTaskGetCurrent(), POSCFG_MAX_PRIO_LEVEL - 1);
+
+  locked = nosSemaCreate(0, 0, "locked");
+  done   = nosSemaCreate(0, 0, "done");
+
+  scenario("wait", false);
+  scenario("chained_wait", true);
+#endif
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "wd_test.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/prot/ethernet.h"
+
+#include "wwd_constants.h"
+
+/*
+ * Firmware offloads. Checks that ARP offload and packet
+ * filters are written to simulated firmware, host address
+ * follows netif and configuration is restored after WWD
+ * is reinitialized.
+ */
+
+#define MAX_TYPES 8
+
+static uint32_t iovarU32(const char* name)
+{
+  uint32_t value = 0;
+
+  if (wdSimGetIovar(name, WWD_STA_INTERFACE, &value, sizeof(value)) != sizeof(value))
+    return 0xffffffff;
+
+  return value;
+}
+
+static bool passes(uint16_t type)
+{
+  uint16_t types[MAX_TYPES];
+  int      count;
+  int      i;
+
+  count = wdSimGetPacketFilters(types, MAX_TYPES);
+  for (i = 0; i < count; i++)
+    if (types[i] == type)
+      return true;
+
+  return false;
+}
+
+static void setAddress(void* arg)
+{
+  netif_set_ipaddr(wdTestNetif(), (const ip4_addr_t*)arg);
+}
+
+/*
+ * Let worker task write configuration to firmware.
+ */
+static void settle(void)
+{
+  nosTaskSleep(MS(50));
+}
+
+static void check(const ip4_addr_t* ip)
+{
+  WdOffloadStats st;
+  uint16_t       types[MAX_TYPES];
+
+  wdGetOffloadStats(&st);
+  WD_CHECK(st.fwErrors == 0);
+
+#if WDCFG_ARP_OFFLOAD
+  WD_CHECK(st.arpOffload);
+  WD_CHECK(iovarU32("arpoe") == 1);
+  WD_CHECK(iovarU32("arp_ol") != 0xffffffff);
+  WD_CHECK(iovarU32("arp_hostip") == ip4_addr_get_u32(ip));
+#endif
+
+#if WDCFG_PACKET_FILTER
+  WD_CHECK(passes(ETHTYPE_IP));
+  WD_CHECK(passes(ETHTYPE_ARP));
+  WD_CHECK(passes(0x888e));
+  WD_CHECK(passes(ETHTYPE_IPV6) == (LWIP_IPV6 != 0));
+  WD_CHECK(!passes(0x88cc));
+  WD_CHECK(st.packetFilters == (uint32_t)wdSimGetPacketFilters(types, MAX_TYPES));
+#endif
+}
+
+void wdTestMain(void)
+{
+  struct netif* netif;
+  ip4_addr_t    ip;
+
+#if !WDCFG_ARP_OFFLOAD && !WDCFG_PACKET_FILTER
+  wdTestSkip("offloads not enabled");
+#endif
+
+  netif = wdTestNetif();
+  settle();
+  check(netif_ip4_addr(netif));
+
+/*
+ * Address change reaches firmware.
+ */
+  IP4_ADDR(&ip, 192, 168, 99, 3);
+  wdTestInTcpip(setAddress, &ip);
+  settle();
+  check(&ip);
+
+/*
+ * Restarted firmware gets configuration again.
+ */
+  WD_CHECK(wdManagementInit(WICED_COUNTRY_WORLD_WIDE_XX, NULL) == WWD_SUCCESS);
+  WD_CHECK(iovarU32("arpoe") == 0xffffffff);
+  WD_CHECK(!passes(ETHTYPE_IP));
+  settle();
+  check(&ip);
+}
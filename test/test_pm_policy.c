@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wd_test.h"
+
+/*
+ * Trace-driven power-save policy simulation. Traffic trace
+ * (frames per second and transmit queue depth, one sample
+ * per policy run) is fed to wdPowersaveDecide() and resulting
+ * state sequence is checked against thresholds and hysteresis.
+ * Another trace can be given as file with lines
+ * "seconds rate queued". Finally the real policy is run
+ * on simulated bus to check that state times add up
+ * to elapsed wall time.
+ */
+
+/*
+ * Same defaults as in pm_policy.c, build overrides
+ * both through compile definitions.
+ */
+#ifndef WDCFG_PM_ACTIVE_ENTER
+#define WDCFG_PM_ACTIVE_ENTER 50
+#endif
+
+#ifndef WDCFG_PM_ACTIVE_EXIT
+#define WDCFG_PM_ACTIVE_EXIT 20
+#endif
+
+#ifndef WDCFG_PM_THROUGHPUT_ENTER
+#define WDCFG_PM_THROUGHPUT_ENTER 5
+#endif
+
+#ifndef WDCFG_PM_THROUGHPUT_EXIT
+#define WDCFG_PM_THROUGHPUT_EXIT 1
+#endif
+
+#ifndef WDCFG_PM_DWELL
+#define WDCFG_PM_DWELL 3
+#endif
+
+#define MAX_PHASES 64
+
+typedef struct {
+
+  uint32_t seconds;
+  uint32_t rate;
+  uint32_t queued;
+} Phase;
+
+/*
+ * Built-in trace: idle, bulk transfer, interactive use,
+ * frames queued while rate is low, rate between active
+ * exit and enter thresholds, idle again.
+ */
+static const Phase builtin[] = {
+  { 30, 0, 0 },
+  { 10, 200, 0 },
+  { 20, 10, 0 },
+  { 5, 0, 3 },
+  { 30, (WDCFG_PM_ACTIVE_ENTER + WDCFG_PM_ACTIVE_EXIT) / 2, 0 },
+  { 60, 0, 0 },
+};
+
+static Phase    phases[MAX_PHASES];
+static int      phaseCount;
+
+static uint32_t transitions;
+static uint32_t seconds[3];
+
+static int loadTrace(const char* fileName)
+{
+  FILE* f;
+  int   n = 0;
+
+  f = fopen(fileName, "r");
+  if (f == NULL) {
+
+    perror(fileName);
+    exit(1);
+  }
+
+  while (n < MAX_PHASES && fscanf(f, "%u %u %u", &phases[n].seconds, &phases[n].rate, &phases[n].queued) == 3)
+    ++n;
+
+  fclose(f);
+  return n;
+}
+
+/*
+ * Wanted state for one sample without hysteresis.
+ */
+static WdPmState wanted(const Phase* p)
+{
+  if (p->queued > 0 || p->rate >= WDCFG_PM_ACTIVE_ENTER)
+    return WD_PM_ACTIVE;
+
+  if (p->rate >= WDCFG_PM_THROUGHPUT_ENTER)
+    return WD_PM_THROUGHPUT;
+
+  return WD_PM_SLEEP;
+}
+
+static uint32_t exitThreshold(WdPmState st)
+{
+  return (st == WD_PM_ACTIVE) ? WDCFG_PM_ACTIVE_EXIT : WDCFG_PM_THROUGHPUT_EXIT;
+}
+
+/*
+ * Run trace through policy. Checks that
+ * - more active state is entered on first sample that needs it
+ * - less active state is entered only after WDCFG_PM_DWELL
+ *   consecutive samples below exit threshold
+ * - state moves at most one step down at a time
+ */
+static void simulate(void)
+{
+  WdPmState st = WD_PM_ACTIVE;
+  WdPmState next;
+  int       down = 0;
+  int       below = 0;
+  int       i;
+  uint32_t  s;
+
+  for (i = 0; i < phaseCount; i++) {
+
+    for (s = 0; s < phases[i].seconds; s++) {
+
+      next = wdPowersaveDecide(st, phases[i].rate, phases[i].queued, &down);
+
+      if (wanted(&phases[i]) <= st) {
+
+        WD_CHECK(next == wanted(&phases[i]));
+        below = 0;
+      }
+      else if (phases[i].rate >= exitThreshold(st)) {
+
+        WD_CHECK(next == st);
+        below = 0;
+      }
+      else if (++below < WDCFG_PM_DWELL) {
+
+        WD_CHECK(next == st);
+      }
+      else {
+
+        WD_CHECK(next == st + 1);
+        below = 0;
+      }
+
+      if (next != st)
+        ++transitions;
+
+      st = next;
+      ++seconds[st];
+    }
+  }
+}
+
+/*
+ * Run real policy on simulated bus with traffic bursts
+ * and check that accounted state times add up.
+ */
+static void accounting(void)
+{
+  WdPowersaveStats st;
+  uint64_t         start;
+  uint32_t         elapsed;
+  uint32_t         total;
+  int              i;
+
+  wdTestNetif();
+
+  start = wdTestNs();
+  wdPowersavePolicyRun();
+
+  for (i = 0; i < 40; i++) {
+
+    wdSimSetRx((i % 20) < 5 ? 200 : 0, 100, NULL, 0x88b5);
+    nosTaskSleep(MS(50));
+    wdPowersavePolicyRun();
+  }
+
+  wdSimSetRx(0, 100, NULL, 0x88b5);
+  wdGetPowersaveStats(&st);
+  elapsed = (uint32_t)((wdTestNs() - start) / 1000000);
+  total = st.time[WD_PM_ACTIVE] + st.time[WD_PM_THROUGHPUT] + st.time[WD_PM_SLEEP];
+
+  wdTestResult("pm_policy", "accounted_ms", total, "ms");
+  wdTestResult("pm_policy", "elapsed_ms", elapsed, "ms");
+  wdTestResult("pm_policy", "run_transitions", st.transitions, "count");
+
+  WD_CHECK(st.transitions > 0);
+  WD_CHECK(st.fwErrors == 0);
+
+/*
+ * Each transition may lose less than one millisecond,
+ * start and end are seen with tick resolution.
+ */
+  WD_CHECK(total <= elapsed + 1);
+  WD_CHECK(total + st.transitions + 2 * 1000 / HZ + 2 >= elapsed);
+}
+
+void wdTestMain(void)
+{
+  uint32_t total;
+
+  if (wdTestArgc > 1) {
+
+    phaseCount = loadTrace(wdTestArgv[1]);
+    WD_CHECK(phaseCount > 0);
+  }
+  else {
+
+    phaseCount = sizeof(builtin) / sizeof(builtin[0]);
+    memcpy(phases, builtin, sizeof(builtin));
+  }
+
+  simulate();
+  total = seconds[WD_PM_ACTIVE] + seconds[WD_PM_THROUGHPUT] + seconds[WD_PM_SLEEP];
+
+  wdTestResult("pm_policy", "transitions", transitions, "count");
+  wdTestResult("pm_policy", "active_pct", 100.0 * seconds[WD_PM_ACTIVE] / total, "%");
+  wdTestResult("pm_policy", "throughput_pct", 100.0 * seconds[WD_PM_THROUGHPUT] / total, "%");
+  wdTestResult("pm_policy", "sleep_pct", 100.0 * seconds[WD_PM_SLEEP] / total, "%");
+
+/*
+ * With built-in trace: two steps down during first idle
+ * phase, up for bulk transfer, down for interactive use,
+ * up for queued frames, two steps down at end. Hysteresis
+ * keeps state active through rate between exit and
+ * enter thresholds.
+ */
+  if (wdTestArgc <= 1) {
+
+    WD_CHECK(seconds[WD_PM_SLEEP] > 0);
+    WD_CHECK(transitions == 7);
+  }
+
+  accounting();
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#include "wd_test.h"
+
+#include "wwd_constants.h"
+#include "RTOS/wwd_rtos_interface.h"
+
+/*
+ * Joining WWD threads. Join must return as soon as thread
+ * has exited (without polling), it can be repeated and
+ * deleting a joined thread releases its resources.
+ */
+
+#define ROUNDS     50
+#define STACK_SIZE 4096
+
+static volatile uint64_t exitedAt;
+static volatile uint32_t seen;
+
+static void quick(uint32_t arg)
+{
+  seen = arg;
+  exitedAt = wdTestNs();
+}
+
+static void finishing(uint32_t arg)
+{
+  host_thread_type_t* self = (host_thread_type_t*)(uintptr_t)arg;
+
+  seen = 1;
+  exitedAt = wdTestNs();
+  host_rtos_finish_thread(self);
+  seen = 2; // not reached
+}
+
+static void slow(uint32_t arg)
+{
+  host_rtos_delay_milliseconds(arg);
+  exitedAt = wdTestNs();
+}
+
+void wdTestMain(void)
+{
+  host_thread_type_t thread;
+  WdRtosStats        before;
+  WdRtosStats        after;
+  uint64_t           total = 0;
+  uint64_t           start;
+  uint64_t           tick  = 1000000000ULL / HZ;
+  int                i;
+
+  wdGetRtosStats(&before);
+
+/*
+ * Thread returning from its function. Join latency is
+ * measured from the last thing thread did.
+ */
+  for (i = 0; i < ROUNDS; i++) {
+
+    WD_CHECK(host_rtos_create_thread_with_arg(&thread, quick, "quick", NULL, STACK_SIZE,
+                                              WD_TEST_PRIORITY - 1, i + 100) == WWD_SUCCESS);
+    WD_CHECK(host_rtos_join_thread(&thread) == WWD_SUCCESS);
+    total += wdTestNs() - exitedAt;
+    WD_CHECK(seen == (uint32_t)i + 100);
+
+    WD_CHECK(host_rtos_join_thread(&thread) == WWD_SUCCESS);
+    WD_CHECK(host_rtos_delete_terminated_thread(&thread) == WWD_SUCCESS);
+  }
+
+  wdTestResult("thread_join", "latency_avg", total / ROUNDS, "ns");
+  WD_CHECK(total / ROUNDS < tick / 4);
+
+/*
+ * Thread that terminates itself.
+ */
+  seen = 0;
+  WD_CHECK(host_rtos_create_thread_with_arg(&thread, finishing, "finish", NULL, STACK_SIZE,
+                                            WD_TEST_PRIORITY + 1, (uint32_t)(uintptr_t)&thread) == WWD_SUCCESS);
+  WD_CHECK(host_rtos_join_thread(&thread) == WWD_SUCCESS);
+  WD_CHECK(seen == 1);
+  WD_CHECK(host_rtos_delete_terminated_thread(&thread) == WWD_SUCCESS);
+
+/*
+ * Join waits until thread really exits.
+ */
+  start = wdTestNs();
+  WD_CHECK(host_rtos_create_thread_with_arg(&thread, slow, "slow", NULL, STACK_SIZE,
+                                            WD_TEST_PRIORITY + 1, 50) == WWD_SUCCESS);
+  WD_CHECK(host_rtos_join_thread(&thread) == WWD_SUCCESS);
+  WD_CHECK(wdTestNs() - start >= 50000000ULL);
+  WD_CHECK(wdTestNs() >= exitedAt);
+  WD_CHECK(host_rtos_delete_terminated_thread(&thread) == WWD_SUCCESS);
+
+/*
+ * Everything allocated for threads is released. Stack of a
+ * thread that was still exiting when deleted is freed once
+ * its task is gone.
+ */
+  host_rtos_delay_milliseconds(10);
+  wdGetRtosStats(&after);
+  WD_CHECK(after.semaphores == before.semaphores);
+  WD_CHECK(after.stackBytes == before.stackBytes);
+}
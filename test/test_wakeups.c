@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "wd_test.h"
+
+#include "wwd_constants.h"
+#include "wwd_management.h"
+
+/*
+ * Bus wakeups saved by firmware offloads. A mix of ARP
+ * requests, broadcasts and unicast frames is injected through
+ * simulated firmware, first with offloads installed by driver
+ * and then after firmware has been reinitialized without them.
+ * Each frame passed to host raises a bus interrupt, which
+ * is counted as WWD thread wakeup.
+ */
+
+#define ROUNDS 20
+
+static const uint8_t peerMac[] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t bcast[]   = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+typedef struct {
+
+  uint32_t wakeups;
+  uint32_t delivered;
+  uint32_t arpReplies;
+} Counts;
+
+static int ether(uint8_t* frame, const uint8_t* dst, uint16_t type)
+{
+  memset(frame, '\0', 64);
+  memcpy(frame, dst, 6);
+  memcpy(frame + 6, peerMac, 6);
+  frame[12] = type >> 8;
+  frame[13] = type & 0xff;
+  return 64;
+}
+
+static int arpRequest(uint8_t* frame, const ip4_addr_t* target)
+{
+  static const uint8_t head[] = { 0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, 0x01 };
+
+  ether(frame, bcast, 0x0806);
+  memcpy(frame + 14, head, sizeof(head));
+  memcpy(frame + 22, peerMac, 6);
+  frame[28] = 192;
+  frame[29] = 168;
+  frame[30] = 99;
+  frame[31] = 7;
+  memcpy(frame + 38, &target->addr, 4);
+  return 64;
+}
+
+static void inject(const uint8_t* frame, int len)
+{
+  WD_CHECK(wdSimInject(frame, len, WWD_STA_INTERFACE));
+
+/*
+ * Separate frames, so that each one
+ * gets its own interrupt.
+ */
+  nosTaskSleep(1);
+}
+
+static void mix(Counts* c)
+{
+  struct netif*  netif = wdTestNetif();
+  WdOffloadStats ob;
+  WdOffloadStats oa;
+  WdSimStats     sb;
+  WdSimStats     sa;
+  uint8_t        frame[64];
+  ip4_addr_t     other;
+  int            i;
+
+  IP4_ADDR(&other, 192, 168, 99, 200);
+
+  wdGetOffloadStats(&ob);
+  wdGetSimStats(&sb);
+
+  for (i = 0; i < ROUNDS; i++) {
+
+    inject(frame, arpRequest(frame, netif_ip4_addr(netif)));
+    inject(frame, arpRequest(frame, &other));
+    inject(frame, ether(frame, bcast, 0x88cc));
+    inject(frame, ether(frame, bcast, 0x0800));
+    inject(frame, ether(frame, netif->hwaddr, 0x0800));
+  }
+
+  wdGetOffloadStats(&oa);
+  wdGetSimStats(&sa);
+
+  c->wakeups    = oa.busWakeups - ob.busWakeups;
+  c->delivered  = sa.rxFrames - sb.rxFrames;
+  c->arpReplies = sa.arpReplies - sb.arpReplies;
+}
+
+void wdTestMain(void)
+{
+  Counts   with;
+  Counts   without;
+  uint32_t expected = 2;
+
+#if !WDCFG_ARP_OFFLOAD && !WDCFG_PACKET_FILTER
+  wdTestSkip("offloads not enabled");
+#endif
+
+#if !WDCFG_ARP_OFFLOAD
+  expected += 2;
+#endif
+
+#if !WDCFG_PACKET_FILTER
+  expected += 1;
+#endif
+
+  wdTestNetif();
+
+/*
+ * Let worker task write offloads to firmware.
+ */
+  nosTaskSleep(MS(50));
+  mix(&with);
+
+/*
+ * Reinitialize firmware directly, so that driver
+ * does not restore offloads.
+ */
+  WD_CHECK(wwd_management_init(WICED_COUNTRY_WORLD_WIDE_XX, NULL) == WWD_SUCCESS);
+  mix(&without);
+
+  wdTestResult("wakeups", "frames", ROUNDS * 5, "frames");
+  wdTestResult("wakeups", "with_offload", with.wakeups, "wakeups");
+  wdTestResult("wakeups", "without_offload", without.wakeups, "wakeups");
+  wdTestResult("wakeups", "arp_replies", with.arpReplies, "frames");
+
+  WD_CHECK(with.delivered == ROUNDS * expected);
+  WD_CHECK(with.wakeups == with.delivered);
+  WD_CHECK(without.delivered == ROUNDS * 5);
+  WD_CHECK(without.wakeups == without.delivered);
+  WD_CHECK(with.wakeups < without.wakeups);
+
+#if WDCFG_ARP_OFFLOAD
+  WD_CHECK(with.arpReplies == ROUNDS);
+#endif
+
+  WD_CHECK(without.arpReplies == 0);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "wd_test.h"
+
+#include "lwip/tcpip.h"
+
+#include "wwd_constants.h"
+#include "wwd_management.h"
+
+int    wdTestArgc;
+char** wdTestArgv;
+
+static int           failures;
+static struct netif  netif;
+static struct netif  apNetif;
+static POSSEMA_t     netifReady;
+static POSSEMA_t     tcpipDone;
+
+void wdTestFail(const char* file, int line, const char* expr)
+{
+  printf("%s:%d: check failed: %s\n", file, line, expr);
+  ++failures;
+}
+
+void wdTestSkip(const char* reason)
+{
+  printf("skipped: %s\n", reason);
+  exit(WD_TEST_SKIP);
+}
+
+uint64_t wdTestNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void wdTestResult(const char* bench, const char* metric, double value, const char* unit)
+{
+  printf("{\"bench\":\"%s\",\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n",
+         bench, metric, value, unit);
+  fflush(stdout);
+}
+
+/*
+ * Netif is added in tcpip thread.
+ */
+static void netifAdd(void* arg)
+{
+  ip4_addr_t ip;
+  ip4_addr_t mask;
+  ip4_addr_t gw;
+
+  IP4_ADDR(&ip, 192, 168, 99, 2);
+  IP4_ADDR(&mask, 255, 255, 255, 0);
+  IP4_ADDR(&gw, 192, 168, 99, 1);
+
+  netif_add(&netif, &ip, &mask, &gw, (void*)WWD_STA_INTERFACE, ethernetif_init, tcpip_input);
+  netif_set_default(&netif);
+  netif_set_up(&netif);
+  nosSemaSignal(netifReady);
+}
+
+struct netif* wdTestNetif(void)
+{
+  if (netifReady != NULL)
+    return &netif;
+
+  netifReady = nosSemaCreate(0, 0, "wdtest");
+  P_ASSERT("test semaphore", netifReady != NULL);
+
+  tcpip_init(NULL, NULL);
+  wdManagementInit(WICED_COUNTRY_WORLD_WIDE_XX, NULL);
+  wdSimStart(WD_TEST_PRIORITY + 1);
+
+  tcpip_callback(netifAdd, NULL);
+  nosSemaWait(netifReady, INFINITE);
+  return &netif;
+}
+
+/*
+ * AP netif uses gateway address of station netif.
+ */
+static void apNetifAdd(void* arg)
+{
+  ip4_addr_t ip;
+  ip4_addr_t mask;
+
+  IP4_ADDR(&ip, 192, 168, 99, 1);
+  IP4_ADDR(&mask, 255, 255, 255, 0);
+
+  netif_add(&apNetif, &ip, &mask, IP4_ADDR_ANY4, (void*)WWD_AP_INTERFACE, ethernetif_init, tcpip_input);
+  netif_set_up(&apNetif);
+  nosSemaSignal(netifReady);
+}
+
+struct netif* wdTestApNetif(void)
+{
+  static bool added;
+
+  wdTestNetif();
+  if (added)
+    return &apNetif;
+
+  added = true;
+  tcpip_callback(apNetifAdd, NULL);
+  nosSemaWait(netifReady, INFINITE);
+  return &apNetif;
+}
+
+typedef struct {
+
+  void (*func)(void*);
+  void* arg;
+} TcpipCall;
+
+static void tcpipCall(void* arg)
+{
+  TcpipCall* call = (TcpipCall*)arg;
+
+  call->func(call->arg);
+  nosSemaSignal(tcpipDone);
+}
+
+void wdTestInTcpip(void (*func)(void*), void* arg)
+{
+  TcpipCall call = { func, arg };
+
+  if (tcpipDone == NULL)
+    tcpipDone = nosSemaCreate(0, 0, "wdtcpip");
+
+  tcpip_callback(tcpipCall, &call);
+  nosSemaWait(tcpipDone, INFINITE);
+}
+
+static void testTask(void* arg)
+{
+  wdTestMain();
+  if (failures > 0)
+    printf("%s: %d check(s) failed\n", wdTestArgv[0], failures);
+
+  exit(failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int main(int argc, char** argv)
+{
+  wdTestArgc = argc;
+  wdTestArgv = argv;
+
+  nosInit(testTask, NULL, WD_TEST_PRIORITY, 32768, 0);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ */
+
+
+#ifndef _WD_TEST_H
+#define _WD_TEST_H
+
+#include <picoos.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "lwip/netif.h"
+#include "wiced-driver.h"
+#include "wd_sim.h"
+
+/*
+ * Minimal harness for host port tests and benchmarks.
+ * Each program implements wdTestMain(), which is run in
+ * first Pico]OS task. Exit status is nonzero if a check failed,
+ * WD_TEST_SKIP if feature under test is not compiled in.
+ */
+#define WD_TEST_SKIP     77
+
+/*
+ * Priority of task running wdTestMain(). Tests create
+ * helper tasks with priorities around it.
+ */
+#define WD_TEST_PRIORITY 2
+
+#define WD_CHECK(cond)   do { if (!(cond)) wdTestFail(__FILE__, __LINE__, #cond); } while (0)
+
+extern int    wdTestArgc;
+extern char** wdTestArgv;
+
+void wdTestMain(void);
+
+void wdTestFail(const char* file, int line, const char* expr);
+void wdTestSkip(const char* reason);
+
+/*
+ * Monotonic time in nanoseconds from host, independent
+ * from driver clock.
+ */
+uint64_t wdTestNs(void);
+
+/*
+ * Start lwIP and simulated bus and add station netif.
+ * Returns same netif on subsequent calls.
+ */
+struct netif* wdTestNetif(void);
+
+/*
+ * Add AP netif in same subnet, station netif is added
+ * first if needed. With simulated bus loopback frames
+ * flow between these two.
+ */
+struct netif* wdTestApNetif(void);
+
+/*
+ * Run function in tcpip thread and wait until it returns.
+ */
+void wdTestInTcpip(void (*func)(void*), void* arg);
+
+/*
+ * Print benchmark result as single JSON line, so that
+ * results can be collected by scripts.
+ */
+void wdTestResult(const char* bench, const char* metric, double value, const char* unit);
+
+#endif /* _WD_TEST_H */
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  1. Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+#  2. Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#  3. The name of the author may not be used to endorse or promote
+#     products derived from this software without specific prior written
+#     permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+# OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+# INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+# STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+# OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#
+# Convert event trace ring dumped from glue/trace.c into
+# Chrome trace JSON (chrome://tracing, Perfetto).
+#
+# Usage: wdtrace.py [-c cycles-per-sec] dump output.json
+#
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"WDT1"
+HEADER = struct.Struct("<4sIII")
+ENTRY = struct.Struct("<IIBBH")
+
+FLAG_ISR = 0x01
+
+# Must match WdTraceEvent in glue/wd_trace.h.
+EVENTS = {
+    1: "buf_get",
+    2: "buf_release",
+    3: "tx",
+    4: "tx_queued",
+    5: "rx",
+    6: "sema_wait",
+    7: "sema_wake",
+    8: "sema_signal",
+    9: "queue_push",
+    10: "queue_pop",
+    11: "isr",
+    12: "sema_timeout",
+}
+
+SEMA_WAIT = 6
+SEMA_WAKE = 7
+SEMA_TIMEOUT = 12
+
+# Tasks have sequential ids, tasks beyond registry
+# size share TASK_OTHER.
+TASK_OTHER = 0xffff
+
+DIRECTIONS = {0: "tx", 1: "rx"}
+
+
+def describe(event, arg):
+    if event in (1, 2):
+        return {"dir": DIRECTIONS.get(arg >> 16, arg >> 16), "size": arg & 0xffff}
+
+    if event in (3, 4, 5):
+        return {"len": arg}
+
+    if event in (6, 7, 8, 9, 10, 12):
+        return {"object": "0x%08x" % arg}
+
+    return {}
+
+
+def thread(flags, task):
+    if flags & FLAG_ISR:
+        return "isr"
+
+    if task == TASK_OTHER:
+        return "other tasks"
+
+    return "task %d" % task
+
+
+def load(data):
+    magic, cycles_per_sec, length, head = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a trace dump")
+
+    if len(data) < HEADER.size + length * ENTRY.size:
+        raise ValueError("truncated trace dump")
+
+    # Ring holds last 'length' events, oldest first from head.
+    count = min(head, length)
+    entries = []
+    for n in range(head - count, head):
+        entries.append(ENTRY.unpack_from(data, HEADER.size + (n % length) * ENTRY.size))
+
+    return cycles_per_sec, entries
+
+
+def convert(cycles_per_sec, entries):
+    events = []
+    if not entries:
+        return events
+
+    # Cycle counter is 32 bits, unwrap it assuming that
+    # consecutive events are less than one wrap apart.
+    prev = entries[0][0]
+    ticks = 0
+    for cycles, arg, event, flags, task in entries:
+        ticks += (cycles - prev) & 0xffffffff
+        prev = cycles
+
+        ev = {
+            "name": EVENTS.get(event, "event %d" % event),
+            "ts": ticks * 1e6 / cycles_per_sec,
+            "pid": 0,
+            "tid": thread(flags, task),
+            "args": describe(event, arg),
+        }
+
+        # Semaphore wait and wake form a duration event.
+        if event == SEMA_WAIT:
+            ev["name"] = "sema"
+            ev["ph"] = "B"
+        elif event in (SEMA_WAKE, SEMA_TIMEOUT):
+            ev["name"] = "sema"
+            ev["ph"] = "E"
+            ev["args"]["timeout"] = event == SEMA_TIMEOUT
+        else:
+            ev["ph"] = "i"
+            ev["s"] = "t"
+
+        events.append(ev)
+
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert wiced-driver trace dump to Chrome trace JSON")
+    parser.add_argument("-c", "--cycles-per-sec", type=int, default=0,
+                        help="cycle counter frequency, if not recorded in dump")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+
+    try:
+        cycles_per_sec, entries = load(data)
+    except (ValueError, struct.error) as e:
+        sys.exit("%s: %s" % (args.input, e))
+
+    if args.cycles_per_sec:
+        cycles_per_sec = args.cycles_per_sec
+
+    if not cycles_per_sec:
+        sys.exit("cycle counter frequency not in dump, use -c")
+
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": convert(cycles_per_sec, entries)}, f)
+
+    print("%d events" % len(entries))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2017, Ari Suutari <ari@stonepile.fi>.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  1. Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+#  2. Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#  3. The name of the author may not be used to endorse or promote
+#     products derived from this software without specific prior written
+#     permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+# OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+# INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+# STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+# OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#
+# Pack wifi chip firmware into compressed container understood
+# by glue/resources.c. Each block is compressed independently
+# using LZ4 block format. Packed result is verified by unpacking it.
+#
+# Usage: wdzpack.py [-b blocksize] input output
+#
+
+import argparse
+import struct
+import sys
+import time
+
+MAGIC = b"WDZ1"
+RAW_BLOCK = 0x80000000
+MIN_MATCH = 4
+MF_LIMIT = 12
+LAST_LITERALS = 5
+
+
+def put_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def put_sequence(out, literals, offset, match_len):
+    lit = len(literals)
+    token = min(lit, 15) << 4
+    if match_len:
+        token |= min(match_len - MIN_MATCH, 15)
+
+    out.append(token)
+    if lit >= 15:
+        put_length(out, lit - 15)
+
+    out += literals
+    if match_len:
+        out += struct.pack("<H", offset)
+        if match_len - MIN_MATCH >= 15:
+            put_length(out, match_len - MIN_MATCH - 15)
+
+
+def lz4_compress(data):
+    out = bytearray()
+    table = {}
+    n = len(data)
+    anchor = 0
+    i = 0
+    while i < n - MF_LIMIT:
+        key = data[i:i + MIN_MATCH]
+        cand = table.get(key)
+        table[key] = i
+        if cand is None or i - cand > 65535:
+            i += 1
+            continue
+
+        match_len = MIN_MATCH
+        limit = n - LAST_LITERALS - i
+        while match_len < limit and data[cand + match_len] == data[i + match_len]:
+            match_len += 1
+
+        put_sequence(out, data[anchor:i], i - cand, match_len)
+        i += match_len
+        anchor = i
+
+    put_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress(src, max_len):
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = src[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+
+        out += src[i:i + lit]
+        i += lit
+        if i == len(src):
+            break
+
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        match_len = token & 15
+        if match_len == 15:
+            while True:
+                b = src[i]
+                i += 1
+                match_len += b
+                if b != 255:
+                    break
+
+        match_len += MIN_MATCH
+        start = len(out) - offset
+        for k in range(match_len):
+            out.append(out[start + k])
+
+    if len(out) > max_len:
+        raise ValueError("block too large")
+
+    return bytes(out)
+
+
+def pack(data, block_size):
+    out = bytearray(MAGIC + struct.pack("<II", len(data), block_size))
+    for pos in range(0, len(data), block_size):
+        block = data[pos:pos + block_size]
+        packed = lz4_compress(block)
+        if len(packed) < len(block):
+            out += struct.pack("<I", len(packed)) + packed
+        else:
+            out += struct.pack("<I", len(block) | RAW_BLOCK) + block
+
+    return bytes(out)
+
+
+def unpack(packed):
+    magic, size, block_size = struct.unpack("<4sII", packed[:12])
+    if magic != MAGIC:
+        raise ValueError("bad magic")
+
+    out = bytearray()
+    pos = 12
+    while pos < len(packed):
+        n, = struct.unpack("<I", packed[pos:pos + 4])
+        pos += 4
+        raw = (n & RAW_BLOCK) != 0
+        n &= ~RAW_BLOCK
+        block = packed[pos:pos + n]
+        pos += n
+        out += block if raw else lz4_decompress(block, block_size)
+
+    if len(out) != size:
+        raise ValueError("size mismatch")
+
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack wifi firmware for wiced-driver.")
+    parser.add_argument("-b", "--block-size", type=int, default=2048,
+                        help="uncompressed block size (must not exceed WDCFG_FIRMWARE_MAX_BLOCK)")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+
+    packed = pack(data, args.block_size)
+
+    start = time.monotonic()
+    if unpack(packed) != data:
+        sys.exit("verification failed")
+
+    elapsed = time.monotonic() - start
+
+    with open(args.output, "wb") as f:
+        f.write(packed)
+
+    print("%s: %d -> %d bytes, %d bytes saved (%.1f%%), verified in %.2f s" %
+          (args.output, len(data), len(packed), len(data) - len(packed),
+           100.0 * (len(data) - len(packed)) / max(len(data), 1), elapsed))
+
+
+if __name__ == "__main__":
+    main()
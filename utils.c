@@ -32,6 +32,8 @@
 #include <wiced-driver.h>
 #include "platform_init.h"
 #include "platform_config.h"
+#include "wd_cycles.h"
+#include "wd_trace.h"
 
 /*
  * Do WICED-specific initialization instead of standard CMSIS SystemInit.
@@ -50,12 +52,18 @@ void wdSystemInit()
 
   platform_init_system_clocks();
 
+/*
+ * Start cycle counter for driver timing.
+ */
+  wdCyclesInit();
+
   platform_init_memory();
 
   platform_init_mcu_infrastructure( );
   platform_init_external_devices( );
 
   SystemCoreClock = CPU_CLOCK_HZ;
+  wdTraceInit();
 }
 
 void __attribute__((weak)) portRestoreClocksAfterWakeup()
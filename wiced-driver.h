@@ -37,6 +37,8 @@ extern "C"
 #endif /* __cplusplus */
 
 #include "lwip/netif.h"
+#include "lwip/memp.h"
+#include "wwd_constants.h"
 
 /**
  * Perform job similary to CMSIS SystenInit, but using
@@ -46,6 +48,410 @@ void wdSystemInit(void);
 
 extern err_t ethernetif_init(struct netif *netif);
 
+/**
+ * Use firmware image from memory (for example memory-mapped
+ * flash) instead of loading it from filesystem. Must be called
+ * before WWD is initialized. Passing NULL restores
+ * filesystem loading.
+ */
+void wdSetFirmwareImage(const void* image, uint32_t size);
+
+/**
+ * Use NVRAM image from memory instead of built-in one.
+ */
+void wdSetNvramImage(const void* image, uint32_t size);
+
+/**
+ * Close firmware file and free decompression buffers.
+ * Driver does this when download completes or a new one
+ * starts. If WWD initialization fails in the middle of download,
+ * application can call this to release resources right away.
+ */
+void wdFirmwareRelease(void);
+
+/**
+ * Initialize WWD (using wwd_management_init()) and write
+ * configuration kept by driver (like multicast lists) to firmware.
+ * Applications should call this instead of wwd_management_init(),
+ * also when WWD is reinitialized after wwd_management_deinit().
+ */
+wwd_result_t wdManagementInit(wiced_country_code_t country, void* bufferArg);
+
+/**
+ * Notify driver that lwIP memory pool has become available
+ * again. Tasks waiting for a packet buffer are woken up
+ * when this is called for MEMP_PBUF_POOL. Hook it up in
+ * lwipopts.h:
+ *
+ * #define LWIP_HOOK_MEMP_AVAILABLE(type) wdMempAvailable(type)
+ */
+void wdMempAvailable(memp_t type);
+
+/**
+ * Packet buffer allocation counters for one direction.
+ */
+typedef struct {
+
+  uint32_t allocs;     //!< Successful allocations.
+  uint32_t failures;   //!< Allocation requests that failed because pool was empty.
+  uint32_t limitHits;  //!< Allocation requests refused to keep other direction's reserve.
+  uint32_t waits;      //!< Allocations that had to wait for a buffer.
+} WdBufferCounters;
+
+typedef struct {
+
+  WdBufferCounters tx;
+  WdBufferCounters rx;
+} WdBufferStats;
+
+/**
+ * Get packet buffer allocation counters. Pool reservation
+ * for directions is configured by WDCFG_BUFFER_RX_RESERVE and
+ * WDCFG_BUFFER_TX_RESERVE.
+ */
+void wdGetBufferStats(WdBufferStats* stats);
+
+/**
+ * Transmit queue counters. Frames are queued while
+ * interface is not ready to transmit (association in
+ * progress or no bus credits). Queue length is set by
+ * WDCFG_TX_QUEUE_LEN and maximum wait time by WDCFG_TX_QUEUE_MAX_AGE.
+ */
+typedef struct {
+
+  uint32_t queued;     //!< Frames that had to be queued.
+  uint32_t dropped;    //!< Frames refused because queue was full.
+  uint32_t expired;    //!< Frames dropped after waiting too long.
+  uint32_t depth;      //!< Current queue depth.
+  uint32_t maxDepth;   //!< Maximum queue depth seen.
+  uint32_t totalWait;  //!< Total time in queue for sent frames (ms).
+  uint32_t maxWait;    //!< Maximum time in queue for sent frame (ms).
+} WdTxQueueStats;
+
+/**
+ * Get transmit queue counters for interface.
+ */
+void wdGetTxQueueStats(struct netif* netif, WdTxQueueStats* stats);
+
+/**
+ * Receive ring counters. Ring is used to pass received frames
+ * to tcpip thread in batches when WDCFG_RX_RING_LEN is nonzero.
+ */
+typedef struct {
+
+  uint32_t enqueued;     //!< Frames put into ring.
+  uint32_t dropped;      //!< Frames dropped because ring was full.
+  uint32_t batches;      //!< Number of tcpip thread wakeups that processed frames.
+  uint32_t occupancy;    //!< Current number of frames in ring.
+  uint32_t maxOccupancy; //!< Maximum number of frames in ring.
+  uint32_t scheduleFailures; //!< Failed attempts to post drain callback to tcpip thread.
+} WdRxRingStats;
+
+/**
+ * Get receive ring counters.
+ */
+void wdGetRxRingStats(WdRxRingStats* stats);
+
+/**
+ * Multicast filter counters. Multicast MAC addresses are
+ * reference counted in a table of WDCFG_MCAST_TABLE_SIZE entries.
+ * If table has more than WDCFG_MCAST_HW_MAX addresses
+ * firmware is switched to allmulti mode and frames are
+ * filtered by driver.
+ */
+typedef struct {
+
+  uint32_t joins;        //!< Join requests from lwIP.
+  uint32_t leaves;       //!< Leave requests from lwIP.
+  uint32_t tableFull;    //!< Joins refused because table was full.
+  uint32_t fwUpdates;    //!< Multicast list or allmulti updates sent to firmware.
+  uint32_t fwErrors;     //!< Failed firmware updates.
+  uint32_t hostDropped;  //!< Frames dropped by driver in allmulti mode.
+  uint32_t entries;      //!< Current number of addresses in table.
+  uint32_t allMulti;     //!< Nonzero if firmware is in allmulti mode.
+} WdMulticastStats;
+
+/**
+ * Get multicast filter counters.
+ */
+void wdGetMulticastStats(WdMulticastStats* stats);
+
+/**
+ * Frame classes for receive filter.
+ */
+typedef enum {
+
+  WD_RX_UNICAST,
+  WD_RX_BROADCAST_ARP,
+  WD_RX_BROADCAST,      //!< Broadcast other than ARP.
+  WD_RX_MULTICAST_IPV4,
+  WD_RX_MULTICAST_IPV6,
+  WD_RX_MULTICAST,      //!< Other multicast.
+  WD_RX_CLASS_COUNT
+} WdRxClass;
+
+#define WD_RX_FILTER_ETHERTYPES 8
+#define WD_RX_UNLIMITED         0xffff
+
+/**
+ * Receive filter counters.
+ */
+typedef struct {
+
+  uint32_t runts;                                    //!< Frames too short for ethernet header.
+  uint32_t etherTypeDropped;                         //!< Frames not in ethertype allow-list.
+  uint32_t etherTypeHits[WD_RX_FILTER_ETHERTYPES];   //!< Frames passed by each allow-list entry.
+  uint32_t classPassed[WD_RX_CLASS_COUNT];
+  uint32_t classDropped[WD_RX_CLASS_COUNT];          //!< Frames dropped by rate limit.
+} WdRxFilterStats;
+
+/**
+ * Set ethertype allow-list for receive filter. Frames with other
+ * ethertypes are dropped before they reach lwIP. Empty list
+ * allows all ethertypes. Remember to include EAPOL (0x888e) if
+ * WPA is used. Filter is compiled in when WDCFG_RX_FILTER is 1.
+ */
+void wdRxFilterSetEtherTypes(const uint16_t* types, int count);
+
+/**
+ * Set token bucket rate limit for frame class. Rate is in
+ * frames per second, burst is bucket size. WD_RX_UNLIMITED disables
+ * limit (default) and rate 0 with burst 0 drops whole class.
+ */
+void wdRxFilterSetRate(WdRxClass cls, uint16_t rate, uint16_t burst);
+
+/**
+ * Get receive filter counters.
+ */
+void wdGetRxFilterStats(WdRxFilterStats* stats);
+
+/**
+ * Firmware offload state and counters. ARP offload is enabled
+ * with WDCFG_ARP_OFFLOAD (needs LWIP_NETIF_EXT_STATUS_CALLBACK
+ * to keep firmware host address in sync) and ethertype packet filter
+ * with WDCFG_PACKET_FILTER.
+ */
+typedef struct {
+
+  uint32_t arpOffload;       //!< Nonzero if ARP offload is active.
+  uint32_t packetFilters;    //!< Number of packet filters installed.
+  uint32_t arpHostIpUpdates; //!< Host address updates sent to firmware.
+  uint32_t fwErrors;         //!< Failed firmware requests.
+  uint32_t busWakeups;       //!< WWD thread wakeups by bus interrupts (coalesced interrupts count once).
+} WdOffloadStats;
+
+/**
+ * Get firmware offload counters.
+ */
+void wdGetOffloadStats(WdOffloadStats* stats);
+
+/**
+ * Power-save policy states, from most active to least active.
+ */
+typedef enum {
+
+  WD_PM_ACTIVE,      //!< PM0, MCU sleep disabled.
+  WD_PM_THROUGHPUT,  //!< PM2, MCU sleep disabled.
+  WD_PM_SLEEP,       //!< PM1, MCU sleep enabled.
+  WD_PM_COUNT
+} WdPmState;
+
+typedef struct {
+
+  uint32_t state;              //!< Current state.
+  uint32_t rate;               //!< Frame rate (tx + rx per second) seen by last run.
+  uint32_t runs;               //!< Number of policy runs.
+  uint32_t transitions;        //!< Number of state changes.
+  uint32_t fwErrors;           //!< Failed power-save mode changes.
+  uint32_t enter[WD_PM_COUNT]; //!< Number of times state was entered.
+  uint32_t time[WD_PM_COUNT];  //!< Time spent in state (ms).
+} WdPowersaveStats;
+
+/**
+ * Run power-save policy. Should be called periodically
+ * (for example once per second) after connecting to access point.
+ * Selects Wi-Fi power-save mode and MCU sleep based
+ * on traffic since previous call. First call puts chip and
+ * MCU into active state. Thresholds are configured
+ * with WDCFG_PM_* macros.
+ */
+WdPmState wdPowersavePolicyRun(void);
+
+/**
+ * Policy decision without side effects, useful for simulating
+ * policy with recorded traffic. Rate is in frames per second, queued
+ * is number of frames waiting for transmit and down is hysteresis
+ * counter that must be preserved between calls (start with 0).
+ */
+WdPmState wdPowersaveDecide(WdPmState current, uint32_t rate, uint32_t queued, int* down);
+
+/**
+ * Get power-save policy counters.
+ */
+void wdGetPowersaveStats(WdPowersaveStats* stats);
+
+/**
+ * Traffic counters for driver netif path. Cycles are CPU cycles
+ * spent in low_level_output (TX) and host_network_process_ethernet_data
+ * (RX), divide by frame count to get cycles per packet.
+ */
+typedef struct {
+
+  uint32_t txFrames;
+  uint32_t txBytes;
+  uint64_t txCycles;
+  uint32_t rxFrames;
+  uint32_t rxBytes;
+  uint64_t rxCycles;
+} WdTrafficStats;
+
+/**
+ * Get traffic counters.
+ */
+void wdGetTrafficStats(WdTrafficStats* stats);
+
+/**
+ * Format all driver counters as a JSON object into buffer,
+ * for collecting performance numbers by scripts. Returns
+ * length of output like snprintf (output is truncated if
+ * buffer is too small).
+ */
+int wdStatsFormat(char* buf, int size);
+
+#define WD_BENCH_QUEUE_SIZES 3
+
+/**
+ * Results of host_rtos primitive microbenchmarks. Values
+ * are in CPU cycles unless otherwise noted.
+ */
+typedef struct {
+
+  uint32_t semaRoundTrip;                          //!< Semaphore ping-pong between two threads.
+  uint32_t queueSizes[WD_BENCH_QUEUE_SIZES];       //!< Message sizes used in queue test (bytes).
+  uint32_t queueCycles[WD_BENCH_QUEUE_SIZES];      //!< Time per message passed between threads.
+  uint32_t timeStep;                               //!< Smallest step of host_rtos_get_time (ms).
+  uint32_t timeCycles;                             //!< Cost of host_rtos_get_time call.
+  uint32_t delayUs;                                //!< Actual duration of host_rtos_delay_milliseconds(1) (us).
+} WdRtosBench;
+
+/**
+ * Run host_rtos microbenchmarks, using given number of rounds
+ * for semaphore and queue tests. Starts a helper thread, so
+ * it must not be called concurrently. Compiled in if WDCFG_RTOS_BENCH
+ * is 1, returns -1 otherwise or if test could not be started.
+ */
+int wdRtosBenchmark(WdRtosBench* result, int rounds);
+
+/**
+ * Monotonic time since startup in microseconds. Based on
+ * jiffies, CPU cycle counter gives resolution within a tick.
+ */
+uint64_t wdTimeUs(void);
+
+/**
+ * Monotonic time since startup in milliseconds. Wraps
+ * around after about 49 days.
+ */
+uint32_t wdTimeMs(void);
+
+/**
+ * Copy event trace ring into buffer. Trace is compiled
+ * in if WDCFG_TRACE is 1 (ring size is WDCFG_TRACE_LEN events).
+ * Dump can be decoded with tools/wdtrace.py. Returns number of bytes
+ * copied, -1 if trace is not enabled or buffer is too small.
+ */
+int wdTraceDump(void* buf, int size);
+
+/**
+ * Clear event trace ring.
+ */
+void wdTraceReset(void);
+
+/**
+ * Latency histograms, compiled in when WDCFG_LATENCY_HIST is 1.
+ * Values are in CPU cycles.
+ */
+typedef enum {
+
+  WD_HIST_TX_OUTPUT,  //!< low_level_output entry to return.
+  WD_HIST_TX_SEND,    //!< Time spent in wwd_network_send_ethernet_data.
+  WD_HIST_BUFFER_GET, //!< Packet buffer allocation, including wait.
+  WD_HIST_RX_INPUT,   //!< host_network_process_ethernet_data entry to netif->input return.
+  WD_HIST_ISR_WAKEUP, //!< Bus interrupt entry to WWD thread wakeup.
+  WD_HIST_RX_DROP,    //!< host_network_process_ethernet_data entry to return for frame dropped by driver.
+  WD_HIST_COUNT
+} WdHistogramId;
+
+#define WD_HIST_BUCKETS 32
+
+typedef struct {
+
+  uint32_t count;                   //!< Number of samples.
+  uint32_t max;                     //!< Largest sample.
+  uint64_t total;                   //!< Sum of samples.
+  uint32_t bucket[WD_HIST_BUCKETS]; //!< Bucket n counts samples in [2^(n-1), 2^n), bucket 0 zeros.
+} WdHistogram;
+
+/**
+ * Get copy of latency histogram.
+ */
+void wdGetHistogram(WdHistogramId id, WdHistogram* hist);
+
+/**
+ * Clear all latency histograms.
+ */
+void wdResetHistograms(void);
+
+/**
+ * Counters for RTOS objects owned by driver.
+ */
+typedef struct {
+
+  uint32_t stackBytes;       //!< Heap bytes used by thread stacks, including ones not yet freed after thread exit.
+  uint32_t peakStackBytes;
+  uint32_t semaphores;       //!< Semaphores (including ones used by threads, mutexes and queues).
+  uint32_t peakSemaphores;
+  uint32_t mutexes;
+  uint32_t peakMutexes;
+  uint32_t queues;
+  uint32_t peakQueues;
+} WdRtosStats;
+
+typedef struct {
+
+  const char* name;
+  uint32_t    stackSize;
+  uint32_t    stackUsed;     //!< Stack high-water mark, 0 if not known.
+} WdThreadStats;
+
+typedef struct {
+
+  uint32_t slots;
+  uint32_t messageSize;
+  uint32_t used;
+  uint32_t maxUsed;          //!< Queue high-water depth.
+  uint32_t lockFree;         //!< Nonzero while queue has had one producer and one consumer task (no locking).
+} WdQueueStats;
+
+/**
+ * Get counters for RTOS objects owned by driver.
+ */
+void wdGetRtosStats(WdRtosStats* stats);
+
+/**
+ * Get stack usage of threads created by driver. Stack
+ * high-water mark is available only if Pico]OS uses
+ * POSCFG_TASKSTACKTYPE 0 (so driver can paint the stack).
+ * Returns number of entries filled.
+ */
+int wdGetThreadStats(WdThreadStats* stats, int max);
+
+/**
+ * Get depth of queues created by driver.
+ * Returns number of entries filled.
+ */
+int wdGetQueueStats(WdQueueStats* stats, int max);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif /* __cplusplus */